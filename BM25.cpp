@@ -0,0 +1,32 @@
+#include "./BM25.hpp"
+
+#include <cmath>
+
+namespace searchserver {
+
+BM25::BM25() : num_docs_(0) { }
+
+void BM25::prepare(const vector<uint32_t>& doc_lengths) {
+  num_docs_ = doc_lengths.size();
+
+  double total = 0;
+  for (uint32_t length : doc_lengths) {
+    total += length;
+  }
+  double average = num_docs_ == 0 ? 0 : total / num_docs_;
+
+  norms_.resize(num_docs_);
+  for (size_t i = 0; i < num_docs_; i++) {
+    double ratio = average == 0 ? 1 : doc_lengths[i] / average;
+    norms_[i] = static_cast<float>(kK1 * (1 - kB + kB * ratio));
+  }
+}
+
+float BM25::idf(size_t doc_freq) const {
+  // The "+ 1" keeps the idf positive even for words in most documents
+  double n = static_cast<double>(num_docs_);
+  double df = static_cast<double>(doc_freq);
+  return static_cast<float>(std::log(1 + (n - df + 0.5) / (df + 0.5)));
+}
+
+}  // namespace searchserver
@@ -0,0 +1,63 @@
+#ifndef BM25_HPP_
+#define BM25_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "./Result.hpp"
+
+using std::vector;
+
+namespace searchserver {
+
+// BM25 ranks a document for a word by how often the word occurs in it,
+// damped so that repeating a word has diminishing returns, and normalized
+// by the document's length so that huge files are not favored just for
+// being huge.  Rare words (high inverse document frequency) count for
+// more than common ones.
+//
+//   score = idf * count * (k1 + 1) / (count + norm[doc])
+//   norm[doc] = k1 * (1 - b + b * length[doc] / average_length)
+//
+// The per-document norms are computed once by prepare() so that scoring
+// a posting is one multiply-add and a divide on a small float table.
+class BM25 {
+ public:
+  // Standard BM25 parameters: term frequency saturation and how strongly
+  // document length is normalized
+  static constexpr float kK1 = 1.2f;
+  static constexpr float kB = 0.75f;
+
+  // Constructs a BM25 scorer for an empty collection
+  BM25();
+
+  // Recomputes the collection statistics and the length norm of every
+  // document.  doc_lengths[id] is the number of words in document id.
+  void prepare(const vector<uint32_t>& doc_lengths);
+
+  // Returns the inverse document frequency of a word that shows up in
+  // "doc_freq" of the prepared documents
+  float idf(size_t doc_freq) const;
+
+  // Returns the score a word with inverse document frequency "idf"
+  // contributes to document doc_id, in which it occurs "count" times
+  float score(float idf, uint32_t count, DocId doc_id) const {
+    // Documents added since prepare() are treated as average length
+    float norm = doc_id < norms_.size() ? norms_[doc_id] : kK1;
+    float tf = static_cast<float>(count);
+    return idf * tf * (kK1 + 1) / (tf + norm);
+  }
+
+  // Returns the largest score any posting of a word with inverse document
+  // frequency "idf" can get; scores approach it as the count grows
+  static float max_score(float idf) { return idf * (kK1 + 1); }
+
+ private:
+  vector<float> norms_;
+  size_t num_docs_;
+};
+
+}  // namespace searchserver
+
+#endif  // BM25_HPP_
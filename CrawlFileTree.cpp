@@ -12,19 +12,31 @@
 #include "./CrawlFileTree.hpp"
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <cstdlib>
-
-#include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
-
+#include <cstring>
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "./FileReader.hpp"
+#include "./TextSniffer.hpp"
+#include "./ThreadPool.hpp"
+#include "./Tokenizer.hpp"
+#include "./UringReader.hpp"
 
+using std::list;
 using std::string;
+using std::unique_ptr;
+using std::unordered_set;
 using std::vector;
 
 namespace searchserver {
@@ -33,29 +45,86 @@ namespace searchserver {
 // Internal helper functions and constants
 //////////////////////////////////////////////////////////////////////////////
 
-// Recursively descend into the passed-in directory, looking for files and
-// subdirectories.  Any encountered files are processed via handle_file(); any
-// subdirectories are recusively handled by handle_dir().
+// An entry of a directory worth crawling: a regular file or a directory
+struct DirEntry {
+  string path;
+  bool is_dir;
+  WordIndex::FileStamp stamp;
+};
+
+// What a crawl keeps track of besides the index, to patch an index that
+// already has documents: the paths of all the files found, and the
+// number of files (re-)indexed
+struct CrawlState {
+  WordIndex* index;
+  unordered_set<string> seen;
+  size_t num_changed;
+};
+
+// The size of the buffer directory entries are read into, which holds a
+// few thousand of them
+static constexpr size_t kDirBufferSize = 64 * 1024;
+
+// Opens a directory to list it: "name" relative to the directory open as
+// "dir_fd", or AT_FDCWD for a path.  Returns -1 on failure
+static int open_dir(int dir_fd, const char* name);
+
+// Reads the entries of the passed-in directory, open as "dir_fd", skipping
+// "." and "..", anything that is neither a regular file nor a directory,
+// and files whose name says they are binary (see classify_name()).
 //
-// Note that opendir()/readdir() iterates through a directory's entries in an
+// Note that getdents64() iterates through a directory's entries in an
 // unspecified order; since we need the ordering to be consistent in order
 // to generate consistent DocTables and MemIndices, we do two passes over the
-// contents: the first to extract the data necessary for populating
-// entry_name_st and the second to actually handle the recursive call.
+// contents: the first to read all of the names, which are then sorted, and
+// the second to look at each entry in that order.
+static void list_dir(const string& dir_path, int dir_fd,
+                     vector<DirEntry>* entries);
+
+// Returns the stamp of a file from what stat() returned for it
+static WordIndex::FileStamp stamp_of(const struct stat& sit);
+
+// Records that a file was found, returning true if it needs indexing: if
+// it is not in the index, or is there with another stamp
+static bool needs_indexing(const DirEntry& file, CrawlState* state);
+
+// Forgets a file that needs_indexing() recorded but that turned out not to
+// be text: it doesn't count as changed, and the crawl removes any older
+// version of it from the index like that of a file that is gone
+static void forget_file(const DirEntry& file, CrawlState* state);
+
+// Recursively descend into the passed-in directory, open as "dir_fd",
+// looking for files and subdirectories.  Any encountered files that need
+// indexing are processed via handle_file(); any subdirectories are
+// recusively handled by handle_dir().
 static void handle_dir(const string& dir_path,
-                       DIR* dir_ptr,
-                       WordIndex* word_index);
+                       int dir_fd,
+                       CrawlState* state);
+
+// Crawls the directory with a pool of "num_threads" threads.  See
+// crawl_filetree()
+static void crawl_parallel(const string& root_dir, CrawlState* state,
+                           uint32_t num_threads);
 
-// Read and parse the specified file, then inject it into the MemIndex.
-static void handle_file(const string& fpath, WordIndex* index);
+// Reads a file to index into "contents", or returns false if it is not
+// text: if its name says it is binary, or, unless its name says it is
+// text, if its first kSniffBytes bytes do, in which case no more of it is
+// read.  A file that cannot be read reads as empty text.
+static bool read_text_file(const string& path, string* contents);
+
+// Read and parse the specified file, then inject it into the MemIndex,
+// replacing any older version of it.  Returns false, leaving the index
+// alone, if the file is not text.
+static bool handle_file(const DirEntry& file, WordIndex* index);
 
 //////////////////////////////////////////////////////////////////////////////
 // Externally-exported functions
 //////////////////////////////////////////////////////////////////////////////
 
-bool crawl_filetree(const string& root_dir, WordIndex* index) {
+bool crawl_filetree(const string& root_dir, WordIndex* index,
+                    uint32_t num_threads, size_t* num_changed) {
   struct stat root_stat;
-  DIR* rid = nullptr;
+  int rid = -1;
 
   // Verify we got some valid args.
   if (index == nullptr) {
@@ -74,135 +143,770 @@ bool crawl_filetree(const string& root_dir, WordIndex* index) {
     return false;
   }
 
-  // Try to open the directory using opendir().  If we fail, (e.g., we don't
-  // have permissions on the directory), return a failure. ("man 3 opendir")
-  rid = opendir(root_dir.c_str());
-  if (rid == nullptr) {
+  // Try to open the directory.  If we fail, (e.g., we don't have
+  // permissions on the directory), return a failure. ("man 2 open")
+  rid = open_dir(AT_FDCWD, root_dir.c_str());
+  if (rid == -1) {
     return false;
   }
 
-  // Begin the recursive handling of the directory.
-  handle_dir(root_dir, rid, index);
+  // Begin the recursive handling of the directory, on this thread alone
+  // or on a pool of them.
+  CrawlState state;
+  state.index = index;
+  state.num_changed = 0;
+  if (num_threads > 1) {
+    crawl_parallel(root_dir, &state, num_threads);
+  } else {
+    handle_dir(root_dir, rid, &state);
+  }
+
+  // Drop the documents whose files are gone.
+  vector<string> names;
+  index->list_documents(&names);
+  for (const string& name : names) {
+    if (state.seen.find(name) == state.seen.end()) {
+      index->remove_document(name);
+      state.num_changed++;
+    }
+  }
+
+  // Nothing more will be recorded, so compress the posting list tails and
+  // precompute the scoring statistics.
+  if (state.num_changed != 0) {
+    index->compact();
+  }
+  if (num_changed != nullptr) {
+    *num_changed = state.num_changed;
+  }
 
   // All done.  Release and/or transfer ownership of resources.
-  closedir(rid);
+  close(rid);
   return true;
 }
 
+size_t update_paths(const vector<string>& paths, WordIndex* index) {
+  CrawlState state;
+  state.index = index;
+  state.num_changed = 0;
+
+  // Whatever was at each path before, file or directory, must be found
+  // there again to stay in the index
+  for (const string& path : paths) {
+    struct stat sit;
+    if (stat(path.c_str(), &sit) != 0) {
+      continue;
+    }
+    if (S_ISREG(sit.st_mode)) {
+      DirEntry file{path, false, stamp_of(sit)};
+      if (classify_name(path) != NameKind::kBinary &&
+          needs_indexing(file, &state) && !handle_file(file, index)) {
+        forget_file(file, &state);
+      }
+    } else if (S_ISDIR(sit.st_mode)) {
+      int dir_fd = open_dir(AT_FDCWD, path.c_str());
+      if (dir_fd != -1) {
+        handle_dir(path, dir_fd, &state);
+        close(dir_fd);
+      }
+    }
+  }
+
+  vector<string> names;
+  index->list_documents(&names);
+  for (const string& name : names) {
+    if (state.seen.find(name) != state.seen.end()) {
+      continue;
+    }
+    for (const string& path : paths) {
+      if (is_under(name, path)) {
+        index->remove_document(name);
+        state.num_changed++;
+        break;
+      }
+    }
+  }
+  return state.num_changed;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Internal helper functions
 //////////////////////////////////////////////////////////////////////////////
 
-static void handle_dir(const string& dir_path, DIR* dir_ptr, WordIndex* index) {
-  // We make two passes through the directory.  The first gets the list of
-  // all the metadata necessary to process its entries; the second iterates
-  // does the actual recursive descent.
-
-  struct dirent* dirent = nullptr;
-  struct stat sit;
-
-  // Use the "readdir()" system call to read the directory entries in a
-  // loop ("man 3 readdir").  Exit out of the loop when we reach the end
-  // of the directory.
-
-  // First pass, to populate the "entries" list of item metadata.
-  for (dirent = readdir(dir_ptr); dirent != nullptr;
-       dirent = readdir(dir_ptr)) {
-    // If the directory entry is named "." or "..", ignore it.  Use the C
-    // "continue" expression to begin the next iteration of the loop.  What
-    // field in the dirent could we use to find out the name of the entry?
-    // How do you compare strings in C?
-    if ((strcmp(static_cast<const char*>(dirent->d_name), ".") == 0) ||
-        (strcmp(static_cast<const char*>(dirent->d_name), "..") == 0)) {
-      // We need to pre-emptively decrement 'i' so that we don't erroneously
-      // include "." and ".." in our final entry count.
-      continue;
+static WordIndex::FileStamp stamp_of(const struct stat& sit) {
+  WordIndex::FileStamp stamp;
+  stamp.inode = static_cast<uint64_t>(sit.st_ino);
+  stamp.size = static_cast<uint64_t>(sit.st_size);
+  stamp.mtime_ns = static_cast<int64_t>(sit.st_mtim.tv_sec) * 1000000000 +
+                   sit.st_mtim.tv_nsec;
+  return stamp;
+}
+
+bool is_under(const string& name, const string& dir) {
+  if (name.compare(0, dir.size(), dir) != 0) {
+    return false;
+  }
+  return name.size() == dir.size() ||
+         (!dir.empty() && dir.back() == '/') || name[dir.size()] == '/';
+}
+
+static int open_dir(int dir_fd, const char* name) {
+  return openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+static void list_dir(const string& dir_path, int dir_fd,
+                     vector<DirEntry>* entries) {
+  // Use the "getdents64()" system call to read the directory entries a
+  // buffer at a time ("man 2 getdents").  Exit out of the loop when we
+  // reach the end of the directory.
+
+  // First pass, to read the names, along with the type of file each one
+  // is if the file system says (d_type; "man 3 readdir").
+  vector<std::pair<string, unsigned char>> names;
+  unique_ptr<char[]> buf(new char[kDirBufferSize]);
+  ssize_t len;
+  while ((len = getdents64(dir_fd, buf.get(), kDirBufferSize)) > 0) {
+    for (ssize_t pos = 0; pos < len;) {
+      const struct dirent64* dirent =
+          reinterpret_cast<const struct dirent64*>(buf.get() + pos);
+      pos += dirent->d_reclen;
+
+      // If the directory entry is named "." or "..", ignore it.
+      if ((strcmp(dirent->d_name, ".") == 0) ||
+          (strcmp(dirent->d_name, "..") == 0)) {
+        continue;
+      }
+      names.emplace_back(dirent->d_name, dirent->d_type);
     }
+  }
+  std::sort(names.begin(), names.end());
 
+  // Second pass, to populate the "entries" list of item metadata.
+  for (const auto& [entry_name, type] : names) {
     // We need to append the name of the file to the name of the directory
-    // we're in to get the full filename. So, we'll malloc space for:
-    //     dirpath + "/" + dirent->d_name + '\0'
+    // we're in to get the full filename.
     string path = dir_path;
-    string entry_name = static_cast<const char*>(dirent->d_name);
     if (dir_path.back() != '/') {
       path += '/';
     }
     path += entry_name;
 
-    // Use the "stat()" system call to ask the operating system to give us
-    // information about the file identified by the directory entry (see
-    // also "man 2 stat").
-    if (stat(path.c_str(), &sit) == 0) {
-      // Test to see if the file is a "regular file" using the S_ISREG() macro
-      // described in the stat man page. If so, we'll process the file by
-      // eventually invoking the handle_file() private helper function in our
-      // second pass.
-      //
-      // On the other hand, if the file turns out to be a directory (which you
-      // can find out using the S_ISDIR() macro described on the same page),
-      // then we'll need to recursively process it using/ handle_dir() in our
-      // second pass.
-      //
-      // If it is neither, skip the file.
-
-      if (S_ISREG(sit.st_mode)) {
-        handle_file(path, index);
-      } else if (S_ISDIR(sit.st_mode)) {
-        DIR* sub_dir = opendir(path.c_str());
-        if (sub_dir != nullptr) {
-          handle_dir(path, sub_dir, index);
-          closedir(sub_dir);
-        }
-      } else {
-        // This is neither a file nor a directory, so ignore it.  As before,
-        // we pre-emptively decrement 'i' so that it doesn't get included
-        // in our final entry count.
-        continue;
+    // A directory needs no stamp, and anything the file system says is
+    // neither a file, a directory nor a symbolic link is skipped, so only
+    // files (whose stamp we need) and the entries whose type is not known
+    // yet take a system call.  Use "fstatat()" relative to the directory
+    // so that the kernel doesn't have to walk the whole path again ("man
+    // 2 stat").  Regular files (the S_ISREG() macro) will be indexed and
+    // directories (S_ISDIR()) descended into; anything else is skipped.
+    if (type == DT_DIR) {
+      entries->push_back(DirEntry{path, true, WordIndex::FileStamp()});
+      continue;
+    }
+    if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+      continue;
+    }
+    bool binary_name = classify_name(entry_name) == NameKind::kBinary;
+    if (type == DT_REG && binary_name) {
+      continue;
+    }
+    struct stat sit;
+    if (fstatat(dir_fd, entry_name.c_str(), &sit, 0) == 0 &&
+        ((S_ISREG(sit.st_mode) && !binary_name) || S_ISDIR(sit.st_mode))) {
+      entries->push_back(
+          DirEntry{path, S_ISDIR(sit.st_mode), stamp_of(sit)});
+    }
+  }
+}
+
+static bool needs_indexing(const DirEntry& file, CrawlState* state) {
+  state->seen.insert(file.path);
+  WordIndex::FileStamp stamp;
+  if (state->index->find_stamp(file.path, &stamp) && stamp == file.stamp) {
+    return false;
+  }
+  state->num_changed++;
+  return true;
+}
+
+static void forget_file(const DirEntry& file, CrawlState* state) {
+  state->seen.erase(file.path);
+  state->num_changed--;
+}
+
+static void handle_dir(const string& dir_path, int dir_fd,
+                       CrawlState* state) {
+  vector<DirEntry> entries;
+  list_dir(dir_path, dir_fd, &entries);
+  for (const DirEntry& entry : entries) {
+    if (!entry.is_dir) {
+      if (needs_indexing(entry, state) &&
+          !handle_file(entry, state->index)) {
+        forget_file(entry, state);
       }
+      continue;
+    }
+    // Open the subdirectory by its name in this one
+    const char* name = entry.path.c_str() + entry.path.rfind('/') + 1;
+    int sub_fd = open_dir(dir_fd, name);
+    if (sub_fd != -1) {
+      handle_dir(entry.path, sub_fd, state);
+      close(sub_fd);
     }
   }
 }
 
-static void handle_file(const string& fpath, WordIndex* index) {
-  // TODO: implement
+///////////////////////////////////////////////////////////////////////////////
+// The parallel crawl
+//
+// The crawl runs in two phases on one ThreadPool.  First every directory is
+// listed by a task of its own, which dispatches a task for each of its
+// subdirectories, building a tree of the entries.  Then the files, in the
+// order handle_dir() would visit them, go through a pipeline of three
+// stages, each run by its own tasks:
+//
+//  - readers read files, in order, into a bounded queue, keeping many
+//    files in flight at once through io_uring where the kernel allows;
+//  - tokenizers take files off that queue, split them into words and
+//    group the words with WordIndex::prepare_document();
+//  - indexers add the prepared documents to private indexes, one per run
+//    of kDocsPerRun consecutive files, without any locking.
+//
+// The files being tokenized or waiting to be indexed each hold a slot of a
+// ring of kSlotsPerIndexer slots per indexer; a reader only reads a file
+// once the slot it will take is free, so the pipeline never holds more
+// than that many files at once, however fast the disks are.  Finally the
+// runs' indexes are merged in order, which gives every file the same DocId
+// handle_dir() would.
+///////////////////////////////////////////////////////////////////////////////
+
+// The number of consecutive files indexed into one private index
+static constexpr size_t kDocsPerRun = 256;
+
+// The number of files in flight per indexer, which must be at least
+// kDocsPerRun for the indexers to work in parallel
+static constexpr size_t kSlotsPerIndexer = 2 * kDocsPerRun;
+
+// The number of files read ahead of the tokenizers per tokenizer
+static constexpr size_t kReadAheadPerTokenizer = 2;
+
+// Counts the tasks of a phase that have not finished, so that the crawl
+// can wait for all of them
+class TaskCounter {
+ public:
+  TaskCounter() : pending_(0) {
+    pthread_mutex_init(&lock_, nullptr);
+    pthread_cond_init(&done_, nullptr);
+  }
+  ~TaskCounter() {
+    pthread_cond_destroy(&done_);
+    pthread_mutex_destroy(&lock_);
+  }
+
+  // Call before dispatching a task
+  void start() {
+    pthread_mutex_lock(&lock_);
+    pending_++;
+    pthread_mutex_unlock(&lock_);
+  }
+
+  // Call as the last thing a task does
+  void finish() {
+    pthread_mutex_lock(&lock_);
+    if (--pending_ == 0) {
+      pthread_cond_broadcast(&done_);
+    }
+    pthread_mutex_unlock(&lock_);
+  }
 
-  // Read the contents of the specified file into a string
+  // Waits until every started task has finished
+  void wait() {
+    pthread_mutex_lock(&lock_);
+    while (pending_ != 0) {
+      pthread_cond_wait(&done_, &lock_);
+    }
+    pthread_mutex_unlock(&lock_);
+  }
 
-  // Search the string for all tokens, where anything that is
-  // not an alphabetic character is considered a delimiter
-  // A delimiter marks the end of a token and is not considered a valid part of
-  // the token
+ private:
+  pthread_mutex_t lock_;
+  pthread_cond_t done_;
+  size_t pending_;
+};
+
+// A FIFO queue holding at most a fixed number of items.  push() waits
+// while it is full and pop() while it is empty, until close() is called
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+    : capacity_(capacity), closed_(false) {
+    pthread_mutex_init(&lock_, nullptr);
+    pthread_cond_init(&not_empty_, nullptr);
+    pthread_cond_init(&not_full_, nullptr);
+  }
+  ~BoundedQueue() {
+    pthread_cond_destroy(&not_full_);
+    pthread_cond_destroy(&not_empty_);
+    pthread_mutex_destroy(&lock_);
+  }
+
+  void push(T item) {
+    pthread_mutex_lock(&lock_);
+    while (items_.size() >= capacity_) {
+      pthread_cond_wait(&not_full_, &lock_);
+    }
+    items_.push_back(std::move(item));
+    pthread_cond_signal(&not_empty_);
+    pthread_mutex_unlock(&lock_);
+  }
 
-  // Record each non empty token as a word into the Wordindex specified by
-  // *index
+  // Returns false once the queue is closed and empty
+  bool pop(T* item) {
+    pthread_mutex_lock(&lock_);
+    while (items_.empty() && !closed_) {
+      pthread_cond_wait(&not_empty_, &lock_);
+    }
+    bool popped = !items_.empty();
+    if (popped) {
+      *item = std::move(items_.front());
+      items_.pop_front();
+      pthread_cond_signal(&not_full_);
+    }
+    pthread_mutex_unlock(&lock_);
+    return popped;
+  }
 
-  // Your implementation should also be case in-sensitive and record every word
-  // in all lower-case
+  // Wakes up every pop() once the queue is empty; nothing may be pushed
+  // afterwards
+  void close() {
+    pthread_mutex_lock(&lock_);
+    closed_ = true;
+    pthread_cond_broadcast(&not_empty_);
+    pthread_mutex_unlock(&lock_);
+  }
 
-  FileReader file = FileReader(fpath);
+ private:
+  pthread_mutex_t lock_;
+  pthread_cond_t not_empty_;
+  pthread_cond_t not_full_;
+  list<T> items_;
+  size_t capacity_;
+  bool closed_;
+};
+
+// A directory of the tree built by the first phase: its entries in name
+// order, with the subtree of each subdirectory
+struct DirNode {
+  vector<DirEntry> entries;
+  vector<unique_ptr<DirNode>> subdirs;  // parallel to entries
+};
+
+// A task listing one directory
+class ListDirTask : public ThreadPool::Task {
+ public:
+  explicit ListDirTask(ThreadPool::thread_task_fn f)
+    : ThreadPool::Task(f) { }
+
+  string path;
+  DirNode* node;
+  ThreadPool* pool;
+  TaskCounter* counter;
+};
+
+// A file read by a reader, waiting for a tokenizer
+struct FileContents {
+  size_t file;  // index into CrawlPipeline::files
   string contents;
-  file.read_file(&contents);
-
-  vector<string> tokens;
-  boost::split(tokens, contents, boost::is_any_of(" \t\n\r\f\v"),
-               boost::token_compress_on);
-
-  for (const string& token : tokens) {
-    string word;
-    for (char tok : token) {
-      if (isalpha(tok) != 0) {
-        word += static_cast<char>(tolower(tok));
-      } else {
-        if (!word.empty()) {
-          index->record(word, fpath);
-          word.clear();
-        }
+};
+
+// What the tasks of the pipeline share.  "lock" guards everything after it
+struct CrawlPipeline {
+  // A slot of the ring, which the files whose index is "file" modulo the
+  // number of slots take turns to use
+  struct Slot {
+    size_t file;  // the next file to use the slot
+    bool ready;   // whether "doc" holds that file, ready to be indexed
+    WordIndex::Document doc;
+  };
+
+  explicit CrawlPipeline(size_t read_ahead) : read_queue(read_ahead) { }
+
+  vector<DirEntry> files;
+  BoundedQueue<FileContents> read_queue;
+
+  // Whether each file turned out not to be text, which its reader sets
+  // before handing it on
+  vector<char> rejected;
+
+  // The private index of every run
+  vector<unique_ptr<WordIndex>> parts;
+
+  pthread_mutex_t lock;
+  pthread_cond_t slot_free;
+  pthread_cond_t slot_ready;
+  vector<Slot> slots;
+  size_t next_file;    // the next file to read
+  size_t next_run;     // the next run to index
+  size_t num_readers;  // the readers still reading
+};
+
+// A task running one stage of the pipeline until it runs out of work
+class PipelineTask : public ThreadPool::Task {
+ public:
+  explicit PipelineTask(ThreadPool::thread_task_fn f)
+    : ThreadPool::Task(f) { }
+
+  CrawlPipeline* pipeline;
+  TaskCounter* counter;
+};
+
+static void list_dir_task(ThreadPool::Task* t) {
+  unique_ptr<ListDirTask> task(static_cast<ListDirTask*>(t));
+  // Every task opens its directory by path, rather than relative to its
+  // parent, so that a wide tree doesn't keep a descriptor open for every
+  // directory waiting to be listed
+  int dir_fd = open_dir(AT_FDCWD, task->path.c_str());
+  if (dir_fd != -1) {
+    list_dir(task->path, dir_fd, &task->node->entries);
+    close(dir_fd);
+  }
+
+  DirNode* node = task->node;
+  node->subdirs.resize(node->entries.size());
+  for (size_t i = 0; i < node->entries.size(); i++) {
+    if (!node->entries[i].is_dir) {
+      continue;
+    }
+    node->subdirs[i] = std::make_unique<DirNode>();
+    ListDirTask* sub = new ListDirTask(list_dir_task);
+    sub->path = node->entries[i].path;
+    sub->node = node->subdirs[i].get();
+    sub->pool = task->pool;
+    sub->counter = task->counter;
+    task->counter->start();
+    task->pool->dispatch(sub);
+  }
+  task->counter->finish();
+}
+
+// Takes the next file for a reader to read, once its slot is free.  If
+// "wait" is false and the slot is not free yet, returns false instead of
+// waiting; once there are no files left, returns false and sets "done"
+static bool take_file(CrawlPipeline* pipeline, bool wait, size_t* file,
+                      bool* done) {
+  pthread_mutex_lock(&pipeline->lock);
+  size_t next = pipeline->next_file;
+  if (next == pipeline->files.size()) {
+    pthread_mutex_unlock(&pipeline->lock);
+    *done = true;
+    return false;
+  }
+  const CrawlPipeline::Slot& slot =
+      pipeline->slots[next % pipeline->slots.size()];
+  while (slot.file != next) {
+    if (!wait) {
+      pthread_mutex_unlock(&pipeline->lock);
+      return false;
+    }
+    pthread_cond_wait(&pipeline->slot_free, &pipeline->lock);
+  }
+  pipeline->next_file++;
+  pthread_mutex_unlock(&pipeline->lock);
+  *file = next;
+  return true;
+}
+
+// Reads files with a UringReader, which keeps many of them in flight.
+// Only waits for a slot to free up with no files in flight, since the
+// indexers may be waiting for the ones that are.  Returns false if the
+// ring failed part way, leaving the rest to the caller
+static bool read_with_uring(CrawlPipeline* pipeline, UringReader* ring) {
+  vector<UringReader::File> read;
+  bool done = false;
+  while (true) {
+    size_t file;
+    while (!done && ring->can_submit() &&
+           take_file(pipeline, ring->num_pending() == 0, &file, &done)) {
+      const string& path = pipeline->files[file].path;
+      ring->submit(path, file, classify_name(path) != NameKind::kText);
+    }
+    if (ring->num_pending() == 0) {
+      return done;
+    }
+
+    // A file that cannot be read is indexed empty, as by handle_file()
+    ring->wait(&read);
+    for (UringReader::File& contents : read) {
+      pipeline->rejected[contents.tag] = contents.rejected;
+      pipeline->read_queue.push(
+          FileContents{contents.tag, std::move(contents.contents)});
+    }
+    read.clear();
+    if (!ring->ok()) {
+      return false;
+    }
+  }
+}
+
+static void read_task(ThreadPool::Task* t) {
+  unique_ptr<PipelineTask> task(static_cast<PipelineTask*>(t));
+  CrawlPipeline* pipeline = task->pipeline;
+
+  // Where the kernel allows io_uring, it does the reading; otherwise, or
+  // if the ring fails, read the files one at a time.  Either way only the
+  // head of a file that is not text is read
+  UringReader ring(looks_like_text, kSniffBytes);
+  if (!ring.ok() || !read_with_uring(pipeline, &ring)) {
+    size_t file;
+    bool done = false;
+    while (take_file(pipeline, true, &file, &done)) {
+      FileContents item{file, string()};
+      pipeline->rejected[file] =
+          !read_text_file(pipeline->files[file].path, &item.contents);
+      pipeline->read_queue.push(std::move(item));
+    }
+  }
+
+  pthread_mutex_lock(&pipeline->lock);
+  bool last = --pipeline->num_readers == 0;
+  pthread_mutex_unlock(&pipeline->lock);
+  if (last) {
+    pipeline->read_queue.close();
+  }
+  task->counter->finish();
+}
+
+static void tokenize_task(ThreadPool::Task* t) {
+  unique_ptr<PipelineTask> task(static_cast<PipelineTask*>(t));
+  CrawlPipeline* pipeline = task->pipeline;
+  FileContents item;
+  vector<std::string_view> words;
+  while (pipeline->read_queue.pop(&item)) {
+    // The slot is reserved for this file, so nothing else touches its
+    // document until it is marked ready
+    words.clear();
+    tokenize(&item.contents, &words);
+    CrawlPipeline::Slot& slot =
+        pipeline->slots[item.file % pipeline->slots.size()];
+    slot.doc = WordIndex::Document();
+    WordIndex::prepare_document(words, &slot.doc);
+    slot.doc.stamp = pipeline->files[item.file].stamp;
+
+    pthread_mutex_lock(&pipeline->lock);
+    slot.ready = true;
+    pthread_cond_broadcast(&pipeline->slot_ready);
+    pthread_mutex_unlock(&pipeline->lock);
+  }
+  task->counter->finish();
+}
+
+static void index_task(ThreadPool::Task* t) {
+  unique_ptr<PipelineTask> task(static_cast<PipelineTask*>(t));
+  CrawlPipeline* pipeline = task->pipeline;
+  size_t num_files = pipeline->files.size();
+  while (true) {
+    pthread_mutex_lock(&pipeline->lock);
+    size_t run = pipeline->next_run;
+    if (run == pipeline->parts.size()) {
+      pthread_mutex_unlock(&pipeline->lock);
+      break;
+    }
+    pipeline->next_run++;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    // Index the run's files in order, freeing each one's slot for the
+    // file that comes kSlotsPerIndexer * indexers files later
+    WordIndex* part = pipeline->parts[run].get();
+    size_t end = std::min(num_files, (run + 1) * kDocsPerRun);
+    for (size_t file = run * kDocsPerRun; file < end; file++) {
+      pthread_mutex_lock(&pipeline->lock);
+      CrawlPipeline::Slot& slot =
+          pipeline->slots[file % pipeline->slots.size()];
+      while (slot.file != file || !slot.ready) {
+        pthread_cond_wait(&pipeline->slot_ready, &pipeline->lock);
+      }
+      WordIndex::Document doc = std::move(slot.doc);
+      slot.file += pipeline->slots.size();
+      slot.ready = false;
+      pthread_cond_broadcast(&pipeline->slot_free);
+      pthread_mutex_unlock(&pipeline->lock);
+
+      if (!pipeline->rejected[file]) {
+        part->add_document(pipeline->files[file].path, doc);
       }
     }
-    if (!word.empty()) {
-      index->record(word, fpath);
+  }
+  task->counter->finish();
+}
+
+// Appends the files of the tree to "files" in the order handle_dir()
+// visits them
+static void collect_files(const DirNode& node, vector<DirEntry>* files) {
+  for (size_t i = 0; i < node.entries.size(); i++) {
+    if (node.subdirs[i] != nullptr) {
+      collect_files(*node.subdirs[i], files);
+    } else if (!node.entries[i].is_dir) {
+      files->push_back(node.entries[i]);
+    }
+  }
+}
+
+static void crawl_parallel(const string& root_dir, CrawlState* state,
+                           uint32_t num_threads) {
+  // Reading mostly waits on the disks and indexing is cheap next to
+  // tokenizing, so most threads tokenize
+  size_t num_readers = std::max<size_t>(1, num_threads / 4);
+  size_t num_indexers = std::max<size_t>(1, num_threads / 4);
+  size_t num_tokenizers =
+      std::max<size_t>(1, num_threads - num_readers - num_indexers);
+  ThreadPool pool(
+      static_cast<uint32_t>(num_readers + num_tokenizers + num_indexers));
+
+  // List the tree
+  CrawlPipeline pipeline(kReadAheadPerTokenizer * num_tokenizers);
+  {
+    DirNode root;
+    TaskCounter counter;
+    ListDirTask* task = new ListDirTask(list_dir_task);
+    task->path = root_dir;
+    task->node = &root;
+    task->pool = &pool;
+    task->counter = &counter;
+    counter.start();
+    pool.dispatch(task);
+    counter.wait();
+
+    // Only the files that changed go down the pipeline
+    vector<DirEntry> files;
+    collect_files(root, &files);
+    for (DirEntry& file : files) {
+      if (needs_indexing(file, state)) {
+        pipeline.files.push_back(std::move(file));
+      }
     }
   }
+  if (pipeline.files.empty()) {
+    return;
+  }
+
+  // Run the pipeline
+  size_t num_runs = (pipeline.files.size() + kDocsPerRun - 1) / kDocsPerRun;
+  for (size_t run = 0; run < num_runs; run++) {
+    pipeline.parts.push_back(std::make_unique<WordIndex>());
+    pipeline.parts.back()->set_positions(state->index->positions());
+  }
+  pipeline.rejected.assign(pipeline.files.size(), false);
+  pthread_mutex_init(&pipeline.lock, nullptr);
+  pthread_cond_init(&pipeline.slot_free, nullptr);
+  pthread_cond_init(&pipeline.slot_ready, nullptr);
+  pipeline.slots.resize(kSlotsPerIndexer * num_indexers);
+  for (size_t i = 0; i < pipeline.slots.size(); i++) {
+    pipeline.slots[i].file = i;
+    pipeline.slots[i].ready = false;
+  }
+  pipeline.next_file = 0;
+  pipeline.next_run = 0;
+  pipeline.num_readers = num_readers;
+
+  TaskCounter counter;
+  auto dispatch = [&](ThreadPool::thread_task_fn f, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      PipelineTask* task = new PipelineTask(f);
+      task->pipeline = &pipeline;
+      task->counter = &counter;
+      counter.start();
+      pool.dispatch(task);
+    }
+  };
+  dispatch(index_task, num_indexers);
+  dispatch(tokenize_task, num_tokenizers);
+  dispatch(read_task, num_readers);
+  counter.wait();
+
+  pthread_cond_destroy(&pipeline.slot_ready);
+  pthread_cond_destroy(&pipeline.slot_free);
+  pthread_mutex_destroy(&pipeline.lock);
+
+  state->index->merge(std::move(pipeline.parts), num_threads);
+  for (size_t file = 0; file < pipeline.files.size(); file++) {
+    if (pipeline.rejected[file]) {
+      forget_file(pipeline.files[file], state);
+    }
+  }
+}
+
+static bool read_text_file(const string& path, string* contents) {
+  contents->clear();
+  NameKind kind = classify_name(path);
+  if (kind == NameKind::kBinary) {
+    return false;
+  }
+  if (kind == NameKind::kText) {
+    FileReader reader(path);
+    reader.read_file(contents);
+    return true;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return true;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return true;
+  }
+
+  // Read the head of the file first, and the rest only if it is text
+  contents->resize(st.st_size);
+  size_t head_size = std::min(contents->size(), kSniffBytes);
+  size_t size = 0;
+  bool sniffed = false;
+  bool is_text = true;
+  while (size < contents->size() && is_text) {
+    size_t end = sniffed ? contents->size() : head_size;
+    ssize_t len = read(fd, contents->data() + size, end - size);
+    if (len <= 0) {
+      break;
+    }
+    size += static_cast<size_t>(len);
+    if (!sniffed && size == head_size) {
+      sniffed = true;
+      is_text = looks_like_text(std::string_view(contents->data(), size));
+    }
+  }
+  close(fd);
+
+  // A file that shrank, or failed to read, before its head was all in is
+  // judged by what there is of it
+  contents->resize(size);
+  if (!sniffed) {
+    is_text = looks_like_text(*contents);
+  }
+  if (!is_text) {
+    contents->clear();
+  }
+  return is_text;
+}
+
+static bool handle_file(const DirEntry& file, WordIndex* index) {
+  // Read the file if it is text and split it into lower-cased words in
+  // place with tokenize()
+  string contents;
+  if (!read_text_file(file.path, &contents)) {
+    return false;
+  }
+
+  vector<std::string_view> words;
+  tokenize(&contents, &words);
+
+  // Add the whole document at once; its length, for BM25, is its number
+  // of words
+  WordIndex::Document doc;
+  WordIndex::prepare_document(words, &doc);
+  doc.stamp = file.stamp;
+  index->update_document(file.path, doc);
+  return true;
 }
 
 }  // namespace searchserver
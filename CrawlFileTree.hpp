@@ -14,9 +14,13 @@
 
 #include "./WordIndex.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 using std::string;
+using std::vector;
 
 namespace searchserver {
 
@@ -26,14 +30,56 @@ namespace searchserver {
 // For each file that it encounters, it scans the file to test whether it
 // contains ASCII text data.  If so, it indexes the file into a WordIndex which is returned
 //
+// A file is not text if its extension is one of binary files (".png",
+// ".zip"...), or, unless its extension is one of text files (".txt",
+// ".cpp"...), if its first kSniffBytes bytes hold a NUL or too many
+// control characters; only those first bytes of it are read.  See
+// TextSniffer.hpp.
+//
 // Arguments:
 // - rootdir: the name of the directory which is the root of the crawl.
 //
 // Returns:
 // - index: an output parameter through which a populated WordIndex is returned.
 //
+// - num_threads: how many threads to crawl with.  With more than one, the
+//   directories are listed and the files indexed by a ThreadPool of that
+//   many threads, each file into a private index of its thread's, and the
+//   private indexes are merged into "index" at the end.
+//
+// Either way, the entries of every directory are visited in name order, so
+// crawling the same tree always gives every file the same DocId, whatever
+// the number of threads.
+//
+// - num_changed: if not nullptr, where to return the number of files
+//   added to, updated in or removed from the index.
+//
+// The index may already hold documents, e.g. loaded by WordIndex::open()
+// from an earlier crawl, in which case it is patched rather than rebuilt:
+// the stamp of every file found (see WordIndex::FileStamp) is compared to
+// the one it was last indexed with, and only the files that are new or
+// whose stamp changed are read again, while the documents whose files are
+// gone are removed.  Not safe to run concurrently with lookups.
+//
 // - Returns false on failure to scan the directory, true on success.
-bool crawl_filetree(const string& root_dir, WordIndex *index);
+bool crawl_filetree(const string& root_dir, WordIndex *index,
+                    uint32_t num_threads = 1, size_t* num_changed = nullptr);
+
+// Brings the documents at some paths up to date after they changed, e.g.
+// as reported by a TreeWatcher.  A path that is a regular file is indexed
+// again if its stamp changed, and one that is a directory is crawled,
+// indexing the files under it that are new or changed; the documents at
+// or under any of the paths whose files are no longer there are removed.
+// Unlike crawl_filetree(), does not compact the index, so it is safe to
+// run while the index is serving lookups.
+//
+// Returns: the number of files added to, updated in or removed from the
+// index
+size_t update_paths(const vector<string>& paths, WordIndex* index);
+
+// Returns true if the path "name" is "dir" or a path under it, where both
+// are joined the way the crawl joins the names of documents
+bool is_under(const string& name, const string& dir);
 
 }  // namespace searchserver
 
@@ -0,0 +1,199 @@
+#include "./FrozenIndex.hpp"
+
+#include "./StreamVByte.hpp"
+
+namespace searchserver {
+
+FrozenIndex::FrozenIndex()
+    : words_(nullptr), num_words_(0), blocks_(nullptr), num_blocks_(0),
+      data_(nullptr), data_bytes_(0), impacts_(nullptr), num_impacts_(0),
+      position_offsets_(nullptr), position_data_(nullptr),
+      position_data_bytes_(0) {
+}
+
+void FrozenIndex::add_word(std::string_view word,
+                           const PostingList& postings, float idf) {
+  terms_.add(word);
+
+  Word entry;
+  entry.data_offset = data_storage_.size();
+  entry.first_posting = impacts_storage_.size();
+  entry.first_block = static_cast<uint32_t>(blocks_storage_.size());
+  entry.doc_freq = static_cast<uint32_t>(postings.size());
+  entry.idf = idf;
+  entry.flags = postings.has_positions() ? kWordHasPositions : 0;
+  entry.positions_offset = position_data_storage_.size();
+  words_storage_.push_back(entry);
+
+  // Block offsets are relative to the start of the list's data, so the
+  // headers can be copied over unchanged
+  blocks_storage_.insert(blocks_storage_.end(), postings.blocks().begin(),
+                         postings.blocks().end());
+  data_storage_.insert(data_storage_.end(), postings.data(),
+                       postings.data() + postings.data_bytes());
+  impacts_storage_.insert(impacts_storage_.end(), postings.impacts().begin(),
+                          postings.impacts().end());
+  if (postings.has_positions()) {
+    position_offsets_storage_.insert(position_offsets_storage_.end(),
+                                     postings.position_offsets().begin(),
+                                     postings.position_offsets().end());
+    position_data_storage_.insert(
+        position_data_storage_.end(), postings.position_data(),
+        postings.position_data() + postings.position_data_bytes());
+  } else {
+    position_offsets_storage_.resize(blocks_storage_.size(), 0);
+  }
+}
+
+void FrozenIndex::finish() {
+  data_storage_.resize(data_storage_.size() + kStreamVByteDecodePadding, 0);
+  position_data_storage_.resize(
+      position_data_storage_.size() + kStreamVByteDecodePadding, 0);
+
+  terms_.finish();
+  words_storage_.shrink_to_fit();
+  blocks_storage_.shrink_to_fit();
+  data_storage_.shrink_to_fit();
+  impacts_storage_.shrink_to_fit();
+  position_offsets_storage_.shrink_to_fit();
+  position_data_storage_.shrink_to_fit();
+
+  words_ = words_storage_.data();
+  num_words_ = words_storage_.size();
+  blocks_ = blocks_storage_.data();
+  num_blocks_ = blocks_storage_.size();
+  data_ = data_storage_.data();
+  data_bytes_ = data_storage_.size();
+  impacts_ = impacts_storage_.empty() ? nullptr : impacts_storage_.data();
+  num_impacts_ = impacts_storage_.size();
+  position_offsets_ = position_offsets_storage_.data();
+  position_data_ = position_data_storage_.data();
+  position_data_bytes_ = position_data_storage_.size();
+}
+
+void FrozenIndex::save(IndexFileWriter* writer) const {
+  terms_.save(writer);
+  writer->add_section(kSectionWords, words_, num_words_ * sizeof(Word));
+  writer->add_section(kSectionBlocks, blocks_,
+                      num_blocks_ * sizeof(BlockHeader));
+  writer->add_section(kSectionPostingData, data_, data_bytes_);
+  writer->add_section(kSectionImpacts, impacts_, num_impacts_);
+  writer->add_section(kSectionPositionOffsets, position_offsets_,
+                      num_blocks_ * sizeof(uint32_t));
+  writer->add_section(kSectionPositionData, position_data_,
+                      position_data_bytes_);
+}
+
+bool FrozenIndex::load(const IndexFileReader& reader, size_t num_docs,
+                       string* error) {
+  const void* words;
+  const void* blocks;
+  const void* data;
+  const void* impacts;
+  const void* position_offsets;
+  const void* position_data;
+  size_t num_position_offsets;
+  if (!reader.section(kSectionWords, sizeof(Word), &words, &num_words_) ||
+      !reader.section(kSectionBlocks, sizeof(BlockHeader), &blocks,
+                      &num_blocks_) ||
+      !reader.section(kSectionPostingData, 0, &data, &data_bytes_) ||
+      !reader.section(kSectionImpacts, 0, &impacts, &num_impacts_) ||
+      !reader.section(kSectionPositionOffsets, sizeof(uint32_t),
+                      &position_offsets, &num_position_offsets) ||
+      !reader.section(kSectionPositionData, 0, &position_data,
+                      &position_data_bytes_)) {
+    *error = "the index file is missing the word index";
+    return false;
+  }
+  words_ = static_cast<const Word*>(words);
+  blocks_ = static_cast<const BlockHeader*>(blocks);
+  data_ = static_cast<const uint8_t*>(data);
+  impacts_ = num_impacts_ == 0 ? nullptr
+                               : static_cast<const uint8_t*>(impacts);
+  position_offsets_ = static_cast<const uint32_t*>(position_offsets);
+  position_data_ = static_cast<const uint8_t*>(position_data);
+
+  // Check that the words are sorted, that every word's blocks start inside
+  // the arrays and that no block ends past the last document, so that a
+  // corrupt file cannot send a lookup far out of bounds.  This is one pass
+  // over the word entries and block headers; the compressed postings
+  // themselves are left untouched, so corrupt ones can still decode to
+  // DocIds past the last document (see WordIndex::doc_names()).
+  *error = "the word index in the index file is corrupt";
+  if (!terms_.load(reader, num_words_) ||
+      data_bytes_ < kStreamVByteDecodePadding ||
+      num_position_offsets != num_blocks_ ||
+      position_data_bytes_ < kStreamVByteDecodePadding) {
+    return false;
+  }
+  uint64_t next_block = 0;
+  uint64_t next_posting = 0;
+  for (size_t i = 0; i < num_words_; i++) {
+    const Word& entry = words_[i];
+    uint64_t num_blocks =
+        (entry.doc_freq + kPostingBlockSize - 1) / kPostingBlockSize;
+    if (entry.first_block != next_block ||
+        entry.first_block + num_blocks > num_blocks_ ||
+        entry.data_offset > data_bytes_ - kStreamVByteDecodePadding ||
+        (impacts_ != nullptr && entry.first_posting != next_posting)) {
+      return false;
+    }
+    for (uint64_t b = entry.first_block; b < next_block + num_blocks; b++) {
+      if (blocks_[b].max_doc >= num_docs ||
+          entry.data_offset + blocks_[b].offset >
+              data_bytes_ - kStreamVByteDecodePadding ||
+          ((entry.flags & kWordHasPositions) != 0 &&
+           entry.positions_offset + position_offsets_[b] >
+               position_data_bytes_ - kStreamVByteDecodePadding)) {
+        return false;
+      }
+    }
+    next_block += num_blocks;
+    next_posting += entry.doc_freq;
+  }
+  if (next_block != num_blocks_ ||
+      (impacts_ != nullptr && next_posting != num_impacts_)) {
+    return false;
+  }
+  error->clear();
+  return true;
+}
+
+bool FrozenIndex::find(std::string_view word, PostingListView* postings,
+                       float* idf) const {
+  size_t i;
+  if (!terms_.find(word, &i)) {
+    return false;
+  }
+
+  *postings = this->postings(i);
+  *idf = words_[i].idf;
+  return true;
+}
+
+PostingListView FrozenIndex::postings(size_t i) const {
+  const Word& entry = words_[i];
+  size_t num_blocks =
+      (entry.doc_freq + kPostingBlockSize - 1) / kPostingBlockSize;
+  const uint8_t* impacts =
+      impacts_ == nullptr ? nullptr : &impacts_[entry.first_posting];
+  PostingListView list(&blocks_[entry.first_block], num_blocks,
+                       &data_[entry.data_offset], nullptr, 0, entry.doc_freq,
+                       impacts);
+  if ((entry.flags & kWordHasPositions) != 0) {
+    list.set_positions(&position_offsets_[entry.first_block],
+                       &position_data_[entry.positions_offset], nullptr);
+  }
+  return list;
+}
+
+size_t FrozenIndex::memory_bytes() const {
+  return sizeof(*this) + terms_.memory_bytes() +
+         words_storage_.capacity() * sizeof(Word) +
+         blocks_storage_.capacity() * sizeof(BlockHeader) +
+         data_storage_.capacity() + impacts_storage_.capacity() +
+         position_offsets_storage_.capacity() * sizeof(uint32_t) +
+         position_data_storage_.capacity();
+}
+
+}  // namespace searchserver
@@ -0,0 +1,148 @@
+#ifndef FROZEN_INDEX_HPP_
+#define FROZEN_INDEX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./IndexFile.hpp"
+#include "./PostingList.hpp"
+#include "./TermDictionary.hpp"
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// A FrozenIndex is the read-only layout WordIndex::freeze() converts the
+// index into once crawling is done.  Instead of one hash map node and a
+// few vectors per word, everything lives in a handful of flat arrays in
+// compressed sparse row (CSR) style:
+//
+//  - the words, sorted, in a front-coded TermDictionary;
+//  - one entry per word with its document frequency, its IDF and where
+//    its postings start in the arrays below;
+//  - the block headers of every posting list, back to back;
+//  - the compressed blocks of every posting list, back to back;
+//  - the quantized scores of every posting, if the index has them;
+//  - where the positions of every block start, and the compressed
+//    positions of every posting list, back to back, for the words that
+//    have positions.
+//
+// Looking a word up is a search of the dictionary, and its postings are
+// served as a PostingListView straight out of the arrays.
+// Nothing is ever written after building, so any number of threads can
+// read a FrozenIndex concurrently without locking.
+//
+// The arrays are laid out the same way in memory and on disk: save() writes
+// them into sections of an index file (see IndexFile.hpp) and load() points
+// a FrozenIndex straight at those sections in a mapped file.
+class FrozenIndex {
+ public:
+  // Constructs an empty FrozenIndex
+  FrozenIndex();
+
+  // Appends a word and its postings while building the index.  Words must
+  // be added in strictly increasing order, and the posting list must be
+  // sealed.
+  //
+  // Arguments:
+  //  - word: the word
+  //  - postings: the word's sealed posting list
+  //  - idf: the word's precomputed inverse document frequency
+  void add_word(std::string_view word, const PostingList& postings,
+                float idf);
+
+  // Finishes building the index.  Must be called once, after every word
+  // has been added and before anything is looked up.
+  void finish();
+
+  // Adds the arrays of a finished index to "writer" as sections.  The
+  // index must outlive the writer's write().
+  void save(IndexFileWriter* writer) const;
+
+  // Serves the index out of the sections of a mapped index file instead
+  // of building it.  "reader" must outlive the index, whose DocIds must
+  // all be below "num_docs".
+  //
+  // Returns: false, with a description of the problem in "error", if the
+  // sections are missing or inconsistent, true otherwise
+  bool load(const IndexFileReader& reader, size_t num_docs, string* error);
+
+  // Returns the number of words in the index
+  size_t num_words() const { return num_words_; }
+
+  // Looks up a word in the index.
+  //
+  // Returns: false if the word is not in the index.  Otherwise returns
+  // true along with a view of its postings through "postings" and its
+  // IDF through "idf".
+  bool find(std::string_view word, PostingListView* postings,
+            float* idf) const;
+
+  // Returns the dictionary of the words; the i'th word in it is the i'th
+  // word of the index.  Prefix and fuzzy lookups walk it in sorted order
+  const TermDictionary& words() const { return terms_; }
+
+  // Returns the postings of the i'th word
+  PostingListView postings(size_t i) const;
+
+  // Returns the IDF of the i'th word
+  float idf(size_t i) const { return words_[i].idf; }
+
+  // Returns the number of bytes of heap memory held by the index.  A loaded
+  // index holds none; its arrays live in the mapped file
+  size_t memory_bytes() const;
+
+ private:
+  // Where one word's postings live in the arrays below.  Also the layout
+  // of the words section of an index file
+  struct Word {
+    uint64_t data_offset;
+    uint64_t first_posting;
+    uint32_t first_block;
+    uint32_t doc_freq;
+    float idf;
+    uint32_t flags;
+    uint64_t positions_offset;
+  };
+
+  // Word::flags: the word's postings have positions
+  static constexpr uint32_t kWordHasPositions = 1;
+
+  // The sorted words
+  TermDictionary terms_;
+
+  // The arrays lookups read from.  They point into the vectors below
+  // once finish() has been called, or into a mapped file after load().
+  const Word* words_;
+  size_t num_words_;
+  const BlockHeader* blocks_;
+  size_t num_blocks_;
+  // The compressed blocks, followed by decode padding
+  const uint8_t* data_;
+  size_t data_bytes_;
+  // One quantized score per posting, or nullptr
+  const uint8_t* impacts_;
+  size_t num_impacts_;
+  // One entry per block, relative to the word's positions_offset; zero
+  // for the blocks of words without positions
+  const uint32_t* position_offsets_;
+  // The compressed positions, followed by decode padding
+  const uint8_t* position_data_;
+  size_t position_data_bytes_;
+
+  // Storage for the arrays of an index built with add_word()
+  vector<Word> words_storage_;
+  vector<BlockHeader> blocks_storage_;
+  vector<uint8_t> data_storage_;
+  vector<uint8_t> impacts_storage_;
+  vector<uint32_t> position_offsets_storage_;
+  vector<uint8_t> position_data_storage_;
+};
+
+}  // namespace searchserver
+
+#endif  // FROZEN_INDEX_HPP_
@@ -10,6 +10,10 @@
  */
 
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -23,6 +27,8 @@
 #include "./HttpRequest.hpp"
 #include "./HttpServer.hpp"
 #include "./HttpUtils.hpp"
+#include "./Query.hpp"
+#include "./QueryCache.hpp"
 #include "./WordIndex.hpp"
 
 using std::cerr;
@@ -69,14 +75,21 @@ static void HttpServer_ThrFn(ThreadPool::Task* t);
 // Given a request, produce a response.
 static HttpResponse ProcessRequest(const HttpRequest& req,
                                    const string& base_dir,
-                                   WordIndex* indices);
+                                   WordIndex* indices,
+                                   QueryCache* cache,
+                                   size_t page_size);
 
 // Process a file request.
 static HttpResponse ProcessFileRequest(const string& uri,
                                        const string& base_dir);
 
-// Process a query request.
-static HttpResponse ProcessQueryRequest(const string& uri, WordIndex* index);
+// Formats a result's score for display.
+static string FormatRank(float rank);
+
+// Process a query request, showing "page_size" results per page.  Pages
+// are served out of "cache" when they can be, unless it is nullptr.
+static HttpResponse ProcessQueryRequest(const string& uri, WordIndex* index,
+                                        QueryCache* cache, size_t page_size);
 
 ///////////////////////////////////////////////////////////////////////////////
 // HttpServer
@@ -98,6 +111,8 @@ bool HttpServer::run(void) {
     HttpServerTask* hst = new HttpServerTask(HttpServer_ThrFn);
     hst->base_dir = static_file_dir_path_;
     hst->index = index_;
+    hst->cache = cache_;
+    hst->page_size = page_size_;
     if (!socket_.accept_client(&hst->client_fd, &hst->c_addr, &hst->c_port,
                                &hst->c_dns, &hst->s_addr, &hst->s_dns)) {
       // The accept failed for some reason, so quit out of the server.
@@ -144,7 +159,9 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
     }
 
     // Process the request and generate a response
-    HttpResponse response = ProcessRequest(request, hst->base_dir, hst->index);
+    HttpResponse response = ProcessRequest(request, hst->base_dir,
+                                           hst->index, hst->cache,
+                                           hst->page_size);
 
     // Write the response back to the client
     if (!connection.write_response(response)) {
@@ -167,14 +184,16 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
 
 static HttpResponse ProcessRequest(const HttpRequest& req,
                                    const string& base_dir,
-                                   WordIndex* index) {
+                                   WordIndex* index,
+                                   QueryCache* cache,
+                                   size_t page_size) {
   // Is the user asking for a static file?
   if (req.uri().substr(0, 8) == "/static/") {
     return ProcessFileRequest(req.uri(), base_dir);
   }
 
   // The user must be asking for a query.
-  return ProcessQueryRequest(req.uri(), index);
+  return ProcessQueryRequest(req.uri(), index, cache, page_size);
 }
 
 static HttpResponse ProcessFileRequest(const string& uri,
@@ -269,45 +288,98 @@ static HttpResponse ProcessFileRequest(const string& uri,
   return ret;
 }
 
-static HttpResponse ProcessQueryRequest(const string& uri, WordIndex* index) {
+static string FormatRank(float rank) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f", rank);
+  return buf;
+}
+
+static HttpResponse ProcessQueryRequest(const string& uri, WordIndex* index,
+                                        QueryCache* cache, size_t page_size) {
   // The response we're building up.
   HttpResponse ret;
 
   // Add the 5950gle logo and the search box/button to the response body
   ret.AppendToBody(kFivegleStr);
 
+  // Pull the search terms and the (1-based) page number out of the URI,
+  // e.g. "/query?terms=foo+bar&page=2"
+  URLParser parser;
+  parser.parse(uri);
+  map<string, string> args = parser.args();
   string search_query;
-  if (!uri.empty() && uri.find("/query?terms=") == 0) {
-    size_t pos = uri.find("=");
-    if (pos != string::npos) {
-      search_query = uri.substr(pos + 1);
+  size_t page = 1;
+  if (parser.path() == "/query") {
+    search_query = args["terms"];
+    if (!args["page"].empty()) {
+      // Cap the page so that its offset can't wrap around to the offset of
+      // an earlier page; any page that far in is empty anyway
+      page = std::clamp<size_t>(strtoul(args["page"].c_str(), nullptr, 10),
+                                1, SIZE_MAX / page_size);
     }
   }
 
+  // Leave the case alone: parse_query() lower-cases the words itself but
+  // needs to see the upper-case ORs
+  boost::algorithm::trim(search_query);
+
   // If a search query is present, process it
   if (!search_query.empty()) {
-    // Convert search query to lowercase
-    boost::algorithm::to_lower(search_query);
-
-    // Tokenize the search query
-    vector<string> search_terms;
-    boost::algorithm::split(search_terms, search_query, boost::is_any_of("+"));
-    for (auto& term : search_terms) {
-      term = boost::algorithm::trim_copy(term);
+    // Parse the search query into words and "quoted phrases"
+    Query query = parse_query(search_query);
+
+    // Perform the search, only fetching the requested page.  The
+    // generation is read first so that a page is never cached as current
+    // if the index changed while it was being looked up, and the numbering
+    // before it so that the search runs again if the index was rebuilt
+    // before the names of the results were looked up.
+    size_t offset = (page - 1) * page_size;
+    size_t num_results = 0;
+    vector<Result> results;
+    vector<string> doc_names;
+    while (true) {
+      uint64_t numbering = index->numbering();
+      uint64_t generation = index->generation();
+      if (cache == nullptr ||
+          !cache->lookup(query, page_size, offset, generation, &results,
+                         &num_results)) {
+        results = index->lookup_query(query, page_size, offset, &num_results);
+        if (cache != nullptr) {
+          cache->insert(query, page_size, offset, generation, results,
+                        num_results);
+        }
+      }
+      if (index->doc_names(results, numbering, &doc_names)) {
+        break;
+      }
     }
 
-    // Perform the search
-    vector<Result> results = index->lookup_query(search_terms);
-
     // Add the search results to the response body
     ret.AppendToBody("<h2>Search results:</h2>\n");
-    ret.AppendToBody("<p>" + std::to_string(results.size()) +
-                     " results found for \"" + search_query + "\"</p>\n");
-    for (const auto& result : results) {
-      ret.AppendToBody("<p><a href=\"/static/" + result.doc_name + "\">" +
-                       result.doc_name + "</a> (" +
-                       std::to_string(result.rank) + ")</p>\n");
+    ret.AppendToBody("<p>" + std::to_string(num_results) +
+                     " results found for \"" + escape_html(search_query) +
+                     "\"</p>\n");
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& result = results[i];
+      const string& doc_name = doc_names[i];
+      ret.AppendToBody("<p><a href=\"/static/" + doc_name + "\">" +
+                       doc_name + "</a> (" + FormatRank(result.rank) +
+                       ")</p>\n");
+    }
+
+    // Link to the neighbouring pages
+    string page_uri =
+        escape_html("/query?terms=" + encode_URI(search_query) + "&page=");
+    ret.AppendToBody("<p>\n");
+    if (page > 1) {
+      ret.AppendToBody("<a href=\"" + page_uri + std::to_string(page - 1) +
+                       "\">&lt; Previous</a>\n");
+    }
+    if (page < (num_results + page_size - 1) / page_size) {
+      ret.AppendToBody("<a href=\"" + page_uri + std::to_string(page + 1) +
+                       "\">Next &gt;</a>\n");
     }
+    ret.AppendToBody("</p>\n");
   }
 
   // Set the content type and return the response
@@ -17,6 +17,7 @@
 #include <list>
 
 #include "./ThreadPool.hpp"
+#include "./QueryCache.hpp"
 #include "./ServerSocket.hpp"
 #include "./WordIndex.hpp"
 
@@ -25,15 +26,22 @@ namespace searchserver {
 // The HttpServer class contains the main logic for the web server.
 class HttpServer {
  public:
+  // The number of query results shown per page unless configured otherwise
+  static constexpr size_t kDefaultPageSize = 10;
+
   // Creates a new HttpServer object for port "port" and serving
   // files out of path "staticfile_dirpath".  The index for
   // query processing is loaded already and onwership of
-  // the index is not taken.
+  // the index is not taken.  Query results are shown
+  // "page_size" at a time.  Pages are cached in "cache" (whose
+  // ownership is not taken either) unless it is nullptr.
   explicit HttpServer(uint16_t port,
                       const std::string &static_file_dir_path,
-                      WordIndex* index)
+                      WordIndex* index,
+                      size_t page_size = kDefaultPageSize,
+                      QueryCache* cache = nullptr)
     : socket_(port), static_file_dir_path_(static_file_dir_path),
-      index_(index) { }
+      index_(index), page_size_(page_size), cache_(cache) { }
 
   // The destructor closes the listening socket if it is open and
   // also kills off any threads in the threadpool.
@@ -51,6 +59,8 @@ class HttpServer {
   ServerSocket socket_;
   std::string static_file_dir_path_;
   WordIndex* index_;
+  size_t page_size_;
+  QueryCache* cache_;
   static const int kNumThreads;
 };
 
@@ -68,6 +78,8 @@ class HttpServerTask : public ThreadPool::Task {
   std::string c_addr, c_dns, s_addr, s_dns;
   std::string base_dir;
   WordIndex *index;
+  QueryCache *cache;
+  size_t page_size;
 };
 
 }  // namespace searchserver
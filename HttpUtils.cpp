@@ -156,6 +156,24 @@ string decode_URI(const string& from) {
   return retstr;
 }
 
+string encode_URI(const string& from) {
+  static const char* kHexDigits = "0123456789ABCDEF";
+  string retstr;
+
+  for (unsigned char c : from) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+      retstr.append(1, c);
+    } else if (c == ' ') {
+      retstr.append(1, '+');
+    } else {
+      retstr.append(1, '%');
+      retstr.append(1, kHexDigits[c >> 4]);
+      retstr.append(1, kHexDigits[c & 0xF]);
+    }
+  }
+  return retstr;
+}
+
 void URLParser::parse(const string& url) {
   url_ = url;
 
@@ -59,6 +59,11 @@ std::string escape_html(const std::string &from);
 //
 std::string decode_URI(const std::string &from);
 
+// This function performs URI encoding, the inverse of decode_URI().
+// Letters, digits and "-_.~" are copied as-is, spaces become "+" and
+// every other byte becomes a "%XY" token.
+std::string encode_URI(const std::string &from);
+
 // A URL that's part of a web request has the following structure:
 //
 //   /foo/bar/baz?field=value&field2=value2
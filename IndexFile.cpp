@@ -0,0 +1,193 @@
+#include "./IndexFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace searchserver {
+
+// The fixed part of the file in front of the section table
+struct IndexFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t num_sections;
+  uint32_t reserved;
+};
+
+// Every section starts on a multiple of this
+static constexpr size_t kSectionAlignment = 8;
+
+static size_t align_up(size_t n) {
+  return (n + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+// Writes all "n" bytes at "data" to "fd", retrying short writes
+static bool write_all(int fd, const void* data, size_t n) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (n > 0) {
+    ssize_t written = write(fd, p, n);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += written;
+    n -= written;
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// IndexFileWriter
+///////////////////////////////////////////////////////////////////////////////
+void IndexFileWriter::add_section(IndexSectionId id, const void* data,
+                                  size_t bytes) {
+  sections_.push_back(Pending{id, data, bytes});
+}
+
+bool IndexFileWriter::write(const string& path) const {
+  IndexFileHeader header;
+  memcpy(header.magic, kIndexFileMagic, sizeof(header.magic));
+  header.version = kIndexFileVersion;
+  header.byte_order = kIndexFileByteOrder;
+  header.num_sections = static_cast<uint32_t>(sections_.size());
+  header.reserved = 0;
+
+  // Lay the sections out after the table
+  vector<IndexSection> table;
+  size_t offset = align_up(sizeof(header) +
+                           sections_.size() * sizeof(IndexSection));
+  for (const Pending& pending : sections_) {
+    table.push_back(IndexSection{pending.id, 0, offset, pending.bytes});
+    offset = align_up(offset + pending.bytes);
+  }
+
+  string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return false;
+  }
+
+  static const uint8_t zeros[kSectionAlignment] = {0};
+  size_t pos = sizeof(header) + table.size() * sizeof(IndexSection);
+  bool ok = write_all(fd, &header, sizeof(header)) &&
+            write_all(fd, table.data(), table.size() * sizeof(IndexSection));
+  for (size_t i = 0; ok && i < sections_.size(); i++) {
+    ok = write_all(fd, zeros, table[i].offset - pos) &&
+         write_all(fd, sections_[i].data, sections_[i].bytes);
+    pos = table[i].offset + sections_[i].bytes;
+  }
+  ok = ok && fsync(fd) == 0;
+  ok = (close(fd) == 0) && ok;
+
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) == -1) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// IndexFileReader
+///////////////////////////////////////////////////////////////////////////////
+IndexFileReader::IndexFileReader()
+    : base_(nullptr), size_(0), table_(nullptr), num_sections_(0) { }
+
+IndexFileReader::~IndexFileReader() {
+  if (base_ != nullptr) {
+    munmap(const_cast<uint8_t*>(base_), size_);
+  }
+}
+
+bool IndexFileReader::open(const string& path, string* error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    *error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    *error = path + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+  if (static_cast<size_t>(st.st_size) < sizeof(IndexFileHeader)) {
+    *error = path + " is too short to be an index file";
+    close(fd);
+    return false;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    *error = path + ": " + strerror(errno);
+    return false;
+  }
+  base_ = static_cast<const uint8_t*>(base);
+  size_ = st.st_size;
+
+  const IndexFileHeader* header =
+      reinterpret_cast<const IndexFileHeader*>(base_);
+  if (memcmp(header->magic, kIndexFileMagic, sizeof(header->magic)) != 0) {
+    *error = path + " is not an index file";
+    return false;
+  }
+  if (header->version != kIndexFileVersion) {
+    *error = path + " has format version " +
+             std::to_string(header->version) + ", expected " +
+             std::to_string(kIndexFileVersion);
+    return false;
+  }
+  if (header->byte_order != kIndexFileByteOrder) {
+    *error = path + " was written on a machine with another byte order";
+    return false;
+  }
+
+  num_sections_ = header->num_sections;
+  if (num_sections_ > (size_ - sizeof(*header)) / sizeof(IndexSection)) {
+    *error = path + " is truncated";
+    return false;
+  }
+  table_ = reinterpret_cast<const IndexSection*>(base_ + sizeof(*header));
+  for (size_t i = 0; i < num_sections_; i++) {
+    const IndexSection& s = table_[i];
+    if (s.offset % kSectionAlignment != 0 || s.offset > size_ ||
+        s.bytes > size_ - s.offset) {
+      *error = path + " is truncated or corrupt";
+      return false;
+    }
+  }
+
+  // Tell the kernel to start paging the file in; lookups will touch
+  // most of it soon anyway
+  madvise(const_cast<uint8_t*>(base_), size_, MADV_WILLNEED);
+  return true;
+}
+
+bool IndexFileReader::section(IndexSectionId id, size_t elem_size,
+                              const void** data, size_t* count) const {
+  for (size_t i = 0; i < num_sections_; i++) {
+    if (table_[i].id != id) {
+      continue;
+    }
+    size_t bytes = table_[i].bytes;
+    if (elem_size != 0 && bytes % elem_size != 0) {
+      return false;
+    }
+    *data = base_ + table_[i].offset;
+    *count = elem_size == 0 ? bytes : bytes / elem_size;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace searchserver
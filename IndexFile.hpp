@@ -0,0 +1,128 @@
+#ifndef INDEX_FILE_HPP_
+#define INDEX_FILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// The on-disk index format written by WordIndex::save() and read back by
+// WordIndex::open().  A file is a fixed header followed by a table of
+// sections and then the sections themselves:
+//
+//   magic     8 bytes, kIndexFileMagic
+//   version   uint32_t, kIndexFileVersion
+//   byte order uint32_t, kIndexFileByteOrder as written by the machine that
+//             saved the file; files are only readable on machines with the
+//             same byte order
+//   count     uint32_t, the number of sections
+//   reserved  uint32_t, zero
+//   table     "count" IndexSection entries
+//   sections  the raw bytes of every section, each starting on an 8-byte
+//             boundary
+//
+// Sections hold plain arrays in the layout they have in memory, so that
+// the index can be served straight out of the mapped file without copying
+// or parsing anything.  Bump kIndexFileVersion whenever any of those
+// layouts change, or whenever the crawl changes which files it indexes or
+// how, since the documents of files that haven't changed since the file
+// was saved are kept as they are.
+static constexpr char kIndexFileMagic[8] = {'S', 'S', 'I', 'N',
+                                            'D', 'E', 'X', '\0'};
+static constexpr uint32_t kIndexFileVersion = 6;
+static constexpr uint32_t kIndexFileByteOrder = 0x01020304;
+
+// Identifies what a section holds.  The ids are part of the file format
+enum IndexSectionId : uint32_t {
+  // WordIndex: its scoring parameters, see WordIndex.cpp
+  kSectionParams = 1,
+  // WordIndex: the document names back to back, and the offset of
+  // each name followed by the total length as uint64_t
+  kSectionDocNames = 2,
+  kSectionDocNameOffsets = 3,
+  // WordIndex: the length of every document as uint32_t
+  kSectionDocLengths = 4,
+  // WordIndex: one byte per document, non-zero if it has been removed
+  kSectionDocRemoved = 5,
+  // WordIndex: the FileStamp of every document, the crawl's manifest
+  kSectionDocStamps = 6,
+  // FrozenIndex: its arrays, see FrozenIndex.hpp, and those of its
+  // TermDictionary
+  kSectionTermBytes = 16,
+  kSectionTermBucketOffsets = 17,
+  kSectionWords = 18,
+  kSectionBlocks = 19,
+  kSectionPostingData = 20,
+  kSectionImpacts = 21,
+  kSectionPositionOffsets = 22,
+  kSectionPositionData = 23,
+};
+
+// One entry of the section table
+struct IndexSection {
+  uint32_t id;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+// Collects the sections of an index file and writes them out
+class IndexFileWriter {
+ public:
+  IndexFileWriter() = default;
+
+  // Adds a section holding the "bytes" bytes at "data".  The bytes are not
+  // copied and must stay valid until write() returns.
+  void add_section(IndexSectionId id, const void* data, size_t bytes);
+
+  // Writes the file.  The file is written under a temporary name and
+  // renamed over "path" once complete, so a reader never sees a partial
+  // file.  Returns false if the file could not be written.
+  bool write(const string& path) const;
+
+ private:
+  struct Pending {
+    IndexSectionId id;
+    const void* data;
+    size_t bytes;
+  };
+  vector<Pending> sections_;
+};
+
+// Maps an index file into memory read-only and hands out its sections.
+// The sections stay valid for as long as the IndexFileReader exists.
+class IndexFileReader {
+ public:
+  IndexFileReader();
+  ~IndexFileReader();
+
+  // Maps the file at "path" and checks its header and section table.
+  // Returns false, with a description of the problem in "error", if the
+  // file cannot be mapped or is not an index file this version can read.
+  bool open(const string& path, string* error);
+
+  // Looks up a section.  Returns false if the file has no such section,
+  // or if "elem_size" is not 0 and the section's size is not a multiple
+  // of it.  Otherwise returns the section's start through "data" and its
+  // size in units of "elem_size" (or bytes, if 0) through "count".
+  bool section(IndexSectionId id, size_t elem_size, const void** data,
+               size_t* count) const;
+
+  IndexFileReader(const IndexFileReader& other) = delete;
+  IndexFileReader& operator=(const IndexFileReader& other) = delete;
+
+ private:
+  const uint8_t* base_;
+  size_t size_;
+  const IndexSection* table_;
+  size_t num_sections_;
+};
+
+}  // namespace searchserver
+
+#endif  // INDEX_FILE_HPP_
@@ -0,0 +1,178 @@
+#include "./Intersect.hpp"
+
+#include <immintrin.h>
+
+namespace searchserver {
+
+//////////////////////////////////////////////////////////////////////////////
+// Internal helper functions and constants
+//////////////////////////////////////////////////////////////////////////////
+
+// For every 4-bit match mask, the pshufb mask that moves the matching
+// 32-bit lanes to the front of the register
+struct PackTable4 {
+  uint8_t shuffle[16][16];
+};
+
+static constexpr PackTable4 make_pack_table4() {
+  PackTable4 table{};
+  for (int mask = 0; mask < 16; mask++) {
+    int out = 0;
+    for (int lane = 0; lane < 4; lane++) {
+      if ((mask >> lane) & 1) {
+        for (int b = 0; b < 4; b++) {
+          table.shuffle[mask][4 * out + b] = static_cast<uint8_t>(4 * lane + b);
+        }
+        out++;
+      }
+    }
+    for (int b = 4 * out; b < 16; b++) {
+      table.shuffle[mask][b] = 0xFF;
+    }
+  }
+  return table;
+}
+
+// For every 8-bit match mask, the vpermd indices that move the matching
+// 32-bit lanes to the front of the register
+struct PackTable8 {
+  uint32_t lanes[256][8];
+};
+
+static constexpr PackTable8 make_pack_table8() {
+  PackTable8 table{};
+  for (int mask = 0; mask < 256; mask++) {
+    int out = 0;
+    for (int lane = 0; lane < 8; lane++) {
+      if ((mask >> lane) & 1) {
+        table.lanes[mask][out++] = static_cast<uint32_t>(lane);
+      }
+    }
+    for (; out < 8; out++) {
+      table.lanes[mask][out] = 0;
+    }
+  }
+  return table;
+}
+
+static constexpr PackTable4 kPackTable4 = make_pack_table4();
+static constexpr PackTable8 kPackTable8 = make_pack_table8();
+
+// A merge whose loop body has no data-dependent branches: every step
+// writes the smaller DocId and only bumps the output count on a match
+static size_t intersect_scalar(const DocId* a, size_t na, const DocId* b,
+                               size_t nb, DocId* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  while (i < na && j < nb) {
+    DocId x = a[i];
+    DocId y = b[j];
+    out[k] = x;
+    k += (x == y);
+    i += (x <= y);
+    j += (y <= x);
+  }
+  return k;
+}
+
+// Compares 4 DocIds of a against all 4 rotations of 4 DocIds of b, packs
+// the matches to the front with one shuffle, then advances whichever side
+// has the smaller last element (or both)
+__attribute__((target("sse4.2"))) static size_t intersect_sse(
+    const DocId* a, size_t na, const DocId* b, size_t nb, DocId* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  size_t na4 = na & ~static_cast<size_t>(3);
+  size_t nb4 = nb & ~static_cast<size_t>(3);
+
+  while (i < na4 && j < nb4) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+    __m128i match = _mm_cmpeq_epi32(va, vb);
+    match = _mm_or_si128(
+        match,
+        _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+    match = _mm_or_si128(
+        match,
+        _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+    match = _mm_or_si128(
+        match,
+        _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+
+    DocId a_max = a[i + 3];
+    DocId b_max = b[j + 3];
+    __m128i packed = _mm_shuffle_epi8(
+        va, _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(kPackTable4.shuffle[mask])));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), packed);
+    k += __builtin_popcount(mask);
+    i += (a_max <= b_max) ? 4 : 0;
+    j += (b_max <= a_max) ? 4 : 0;
+  }
+
+  return k + intersect_scalar(a + i, na - i, b + j, nb - j, out + k);
+}
+
+// Same as intersect_sse, but with blocks of 8 and 8 rotations
+__attribute__((target("avx2"))) static size_t intersect_avx2(
+    const DocId* a, size_t na, const DocId* b, size_t nb, DocId* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  size_t na8 = na & ~static_cast<size_t>(7);
+  size_t nb8 = nb & ~static_cast<size_t>(7);
+  const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+
+  while (i < na8 && j < nb8) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+    __m256i match = _mm256_cmpeq_epi32(va, vb);
+    for (int r = 1; r < 8; r++) {
+      vb = _mm256_permutevar8x32_epi32(vb, rotate);
+      match = _mm256_or_si256(match, _mm256_cmpeq_epi32(va, vb));
+    }
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+
+    DocId a_max = a[i + 7];
+    DocId b_max = b[j + 7];
+    __m256i packed = _mm256_permutevar8x32_epi32(
+        va, _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(kPackTable8.lanes[mask])));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), packed);
+    k += __builtin_popcount(mask);
+    i += (a_max <= b_max) ? 8 : 0;
+    j += (b_max <= a_max) ? 8 : 0;
+  }
+
+  return k + intersect_sse(a + i, na - i, b + j, nb - j, out + k);
+}
+
+typedef size_t (*intersect_fn)(const DocId*, size_t, const DocId*, size_t,
+                               DocId*);
+
+// Returns the widest kernel the CPU supports
+static intersect_fn pick_kernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return intersect_avx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return intersect_sse;
+  }
+  return intersect_scalar;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Externally-exported functions
+//////////////////////////////////////////////////////////////////////////////
+
+size_t intersect_doc_ids(const DocId* a, size_t na, const DocId* b, size_t nb,
+                         DocId* out) {
+  static const intersect_fn kernel = pick_kernel();
+  return kernel(a, na, b, nb, out);
+}
+
+}  // namespace searchserver
@@ -0,0 +1,34 @@
+#ifndef INTERSECT_HPP_
+#define INTERSECT_HPP_
+
+#include <cstddef>
+
+#include "./Result.hpp"
+
+namespace searchserver {
+
+// The vector kernels store whole registers, so the output array needs
+// this many DocIds of room past the largest possible result
+static constexpr size_t kIntersectPadding = 8;
+
+// Intersects two sorted arrays of distinct DocIds, writing the DocIds found
+// in both to "out" in sorted order.
+//
+// The work is done by the widest kernel the CPU supports, picked once at
+// runtime: an AVX2 kernel comparing blocks of 8 DocIds against all 8
+// rotations of the other side's block, an SSE4.2 kernel doing the same
+// with blocks of 4, or a branchless scalar merge.
+//
+// Arguments:
+//  - a, na: the first array and its length
+//  - b, nb: the second array and its length
+//  - out: room for min(na, nb) + kIntersectPadding DocIds.  Must not
+//    overlap either input.
+//
+// Returns: the number of DocIds written to "out"
+size_t intersect_doc_ids(const DocId* a, size_t na, const DocId* b, size_t nb,
+                         DocId* out);
+
+}  // namespace searchserver
+
+#endif  // INTERSECT_HPP_
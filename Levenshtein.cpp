@@ -0,0 +1,101 @@
+#include "./Levenshtein.hpp"
+
+#include <algorithm>
+
+namespace searchserver {
+
+LevenshteinAutomaton::LevenshteinAutomaton(std::string_view term,
+                                           int max_distance)
+    : term_(term),
+      max_distance_(static_cast<uint8_t>(
+          std::clamp(max_distance, 0, kMaxDistance))) { }
+
+LevenshteinAutomaton::State LevenshteinAutomaton::start() const {
+  // The empty prefix is i deletions away from term[0, i)
+  State state(term_.size() + 1);
+  for (size_t i = 0; i < state.size(); i++) {
+    state[i] = static_cast<uint8_t>(
+        std::min<size_t>(i, static_cast<size_t>(max_distance_) + 1));
+  }
+  return state;
+}
+
+void LevenshteinAutomaton::step(const State& state, char c,
+                                State* next) const {
+  uint8_t limit = max_distance_ + 1;
+  next->resize(state.size());
+  (*next)[0] = std::min<uint8_t>(state[0] + 1, limit);
+  for (size_t i = 1; i < state.size(); i++) {
+    uint8_t replace = state[i - 1] + (term_[i - 1] == c ? 0 : 1);
+    uint8_t insert = state[i] + 1;
+    uint8_t remove = (*next)[i - 1] + 1;
+    (*next)[i] = std::min({replace, insert, remove, limit});
+  }
+}
+
+bool LevenshteinAutomaton::can_match(const State& state) const {
+  return *std::min_element(state.begin(), state.end()) <= max_distance_;
+}
+
+bool LevenshteinAutomaton::matches(std::string_view word,
+                                   int* distance) const {
+  State state = start();
+  State next;
+  for (char c : word) {
+    step(state, c, &next);
+    state.swap(next);
+    if (!can_match(state)) {
+      return false;
+    }
+  }
+  *distance = this->distance(state);
+  return is_match(state);
+}
+
+void LevenshteinAutomaton::intersect(const TermDictionary& dict,
+                                     vector<Match>* matches) const {
+  // states[d] is the state after reading prefix[0, d)
+  vector<State> states(1, start());
+  string prefix;
+
+  TermDictionary::Iterator it = dict.lower_bound("");
+  while (!it.done()) {
+    std::string_view term = it.term();
+
+    // Reuse the states of the bytes this term shares with the last one
+    size_t d = std::mismatch(prefix.begin(), prefix.end(), term.begin(),
+                             term.end()).first - prefix.begin();
+    prefix.resize(d);
+    while (d < term.size() && can_match(states[d])) {
+      if (states.size() < d + 2) {
+        states.resize(d + 2);
+      }
+      step(states[d], term[d], &states[d + 1]);
+      prefix.push_back(term[d]);
+      d++;
+    }
+
+    if (can_match(states[d])) {
+      if (is_match(states[d])) {
+        matches->push_back(Match{string(term), distance(states[d])});
+      }
+      it.next();
+      continue;
+    }
+
+    // Nothing starting with prefix[0, d) can match; jump to the first term
+    // after all of them, which starts with prefix[0, d) with its last byte
+    // incremented (dropping the bytes that cannot be)
+    string next(prefix, 0, d);
+    while (!next.empty() && static_cast<uint8_t>(next.back()) == 0xff) {
+      next.pop_back();
+    }
+    if (next.empty()) {
+      break;
+    }
+    next.back() = static_cast<char>(static_cast<uint8_t>(next.back()) + 1);
+    it = dict.lower_bound(next);
+  }
+}
+
+}  // namespace searchserver
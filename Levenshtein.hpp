@@ -0,0 +1,83 @@
+#ifndef LEVENSHTEIN_HPP_
+#define LEVENSHTEIN_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./TermDictionary.hpp"
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// A LevenshteinAutomaton accepts the words within a maximum edit distance
+// (insertions, deletions and substitutions of single bytes) of a query
+// term.  It reads a word one byte at a time; its state after reading a
+// prefix of the word is the row of the edit distance table between that
+// prefix and every prefix of the term, with distances past the maximum
+// clipped to one more than it:
+//
+//   row[i] = min(distance(prefix, term[0, i)), max_distance + 1)
+//
+// Once every entry of a row is past the maximum, no word starting with
+// that prefix can match, which is what lets intersect() skip whole runs
+// of a sorted dictionary instead of checking every term.
+class LevenshteinAutomaton {
+ public:
+  using State = vector<uint8_t>;
+
+  // The largest edit distance supported
+  static constexpr int kMaxDistance = 2;
+
+  // A term found by intersect(), with its edit distance from the query
+  // term
+  struct Match {
+    string term;
+    int distance;
+  };
+
+  // Constructs an automaton accepting the words within "max_distance" of
+  // "term".  "max_distance" must be between 0 and kMaxDistance
+  LevenshteinAutomaton(std::string_view term, int max_distance);
+
+  // Returns the state before anything has been read
+  State start() const;
+
+  // Sets "next" to the state after reading "c" in state "state"
+  void step(const State& state, char c, State* next) const;
+
+  // Returns true if the word read so far is accepted
+  bool is_match(const State& state) const {
+    return state.back() <= max_distance_;
+  }
+
+  // Returns the edit distance of the word read so far from the term, or
+  // max_distance + 1 if it is further than that
+  int distance(const State& state) const { return state.back(); }
+
+  // Returns true if some word starting with what was read so far can still
+  // be accepted
+  bool can_match(const State& state) const;
+
+  // Returns true if "word" is accepted, and its distance through
+  // "distance"
+  bool matches(std::string_view word, int* distance) const;
+
+  // Appends every term of "dict" the automaton accepts to "matches", in
+  // sorted order.  The dictionary is walked in order, reusing the states
+  // of the prefix each term shares with the one before it, and jumps past
+  // every term starting with a prefix that cannot match
+  void intersect(const TermDictionary& dict, vector<Match>* matches) const;
+
+ private:
+  string term_;
+  uint8_t max_distance_;
+};
+
+}  // namespace searchserver
+
+#endif  // LEVENSHTEIN_HPP_
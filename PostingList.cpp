@@ -0,0 +1,522 @@
+#include "./PostingList.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "./Intersect.hpp"
+#include "./StreamVByte.hpp"
+
+namespace searchserver {
+
+// When fewer than 1 / kSearchRatio of a decoded block's entries are
+// being looked for, binary search for each of them instead of running
+// the block through an intersection kernel
+static constexpr size_t kSearchRatio = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+// PostingListView
+///////////////////////////////////////////////////////////////////////////////
+PostingListView::PostingListView()
+    : blocks_(nullptr), num_compressed_(0), data_(nullptr), tail_(nullptr),
+      tail_size_(0), size_(0), impacts_(nullptr), has_positions_(false),
+      position_offsets_(nullptr), position_data_(nullptr),
+      tail_positions_(nullptr) { }
+
+PostingListView::PostingListView(const BlockHeader* blocks,
+                                 size_t num_compressed, const uint8_t* data,
+                                 const Posting* tail, size_t tail_size,
+                                 size_t size, const uint8_t* impacts)
+    : blocks_(blocks), num_compressed_(num_compressed), data_(data),
+      tail_(tail), tail_size_(tail_size), size_(size), impacts_(impacts),
+      has_positions_(false), position_offsets_(nullptr),
+      position_data_(nullptr), tail_positions_(nullptr) { }
+
+void PostingListView::set_positions(const uint32_t* block_offsets,
+                                    const uint8_t* data,
+                                    const uint32_t* tail) {
+  has_positions_ = true;
+  position_offsets_ = block_offsets;
+  position_data_ = data;
+  tail_positions_ = tail;
+}
+
+void PostingListView::decode(vector<Posting>* out) const {
+  DocId doc_ids[kPostingBlockSize];
+  uint32_t counts[kPostingBlockSize];
+
+  out->reserve(out->size() + size_);
+  for (size_t b = 0; b < num_blocks(); b++) {
+    size_t n = decode_doc_ids(b, doc_ids);
+    decode_counts(b, counts);
+    for (size_t i = 0; i < n; i++) {
+      out->push_back(Posting{doc_ids[i], counts[i]});
+    }
+  }
+}
+
+void PostingListView::decode(vector<Posting>* out,
+                             vector<uint32_t>* positions) const {
+  DocId doc_ids[kPostingBlockSize];
+  uint32_t counts[kPostingBlockSize];
+  vector<uint32_t> block_positions;
+
+  out->reserve(out->size() + size_);
+  for (size_t b = 0; b < num_blocks(); b++) {
+    size_t n = decode_doc_ids(b, doc_ids);
+    decode_counts(b, counts);
+    decode_positions(b, counts, &block_positions);
+    for (size_t i = 0; i < n; i++) {
+      out->push_back(Posting{doc_ids[i], counts[i]});
+    }
+    positions->insert(positions->end(), block_positions.begin(),
+                      block_positions.end());
+  }
+}
+
+void PostingListView::decode_doc_ids(vector<DocId>* out) const {
+  size_t start = out->size();
+  out->resize(start + size_);
+  for (size_t b = 0; b < num_blocks(); b++) {
+    decode_doc_ids(b, out->data() + start + b * kPostingBlockSize);
+  }
+}
+
+size_t PostingListView::intersect(const DocId* doc_ids, size_t n,
+                                  DocId* out) const {
+  DocId block[kPostingBlockSize];
+  DocId matches[kPostingBlockSize + kIntersectPadding];
+  size_t nb = num_blocks();
+  size_t k = 0;
+  size_t i = 0;
+  size_t b = 0;
+
+  while (i < n) {
+    b = find_block(b, doc_ids[i]);
+    if (b == nb) {
+      break;
+    }
+
+    // doc_ids[i, j) are the DocIds that could be in block b
+    size_t j = std::upper_bound(doc_ids + i, doc_ids + n, block_max(b)) -
+               doc_ids;
+    size_t len = decode_doc_ids(b, block);
+    if ((j - i) * kSearchRatio < len) {
+      for (; i < j; i++) {
+        if (std::binary_search(block, block + len, doc_ids[i])) {
+          out[k++] = doc_ids[i];
+        }
+      }
+    } else {
+      // The kernel may write past its last match, so collect the matches
+      // on the side; copying them over doc_ids[i, j) is fine in place
+      size_t num_matches =
+          intersect_doc_ids(doc_ids + i, j - i, block, len, matches);
+      std::copy(matches, matches + num_matches, out + k);
+      k += num_matches;
+    }
+
+    i = j;
+    b++;
+  }
+
+  return k;
+}
+
+size_t PostingListView::decode_doc_ids(size_t b, DocId* doc_ids) const {
+  size_t n = block_size(b);
+  if (b < num_compressed_) {
+    DocId prev = b == 0 ? 0 : blocks_[b - 1].max_doc;
+    streamvbyte_decode_delta(&data_[blocks_[b].offset], n, prev, doc_ids);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      doc_ids[i] = tail_[i].doc_id;
+    }
+  }
+  return n;
+}
+
+size_t PostingListView::decode_counts(size_t b, uint32_t* counts) const {
+  size_t n = block_size(b);
+  if (b < num_compressed_) {
+    // The counts stream starts right after the DocId stream, whose length
+    // is only known once its control bytes have been read
+    const uint8_t* in = &data_[blocks_[b].offset];
+    in += streamvbyte_encoded_bytes(in, n);
+    streamvbyte_decode(in, n, counts);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      counts[i] = tail_[i].count;
+    }
+  }
+  return n;
+}
+
+void PostingListView::decode_positions(size_t b, const uint32_t* counts,
+                                       vector<uint32_t>* positions) const {
+  size_t n = block_size(b);
+  size_t total = 0;
+  for (size_t i = 0; i < n; i++) {
+    total += counts[i];
+  }
+  positions->resize(total);
+
+  if (b < num_compressed_) {
+    streamvbyte_decode(&position_data_[position_offsets_[b]], total,
+                       positions->data());
+
+    // Add each posting's differences back up
+    uint32_t* p = positions->data();
+    for (size_t i = 0; i < n; i++) {
+      for (size_t j = 1; j < counts[i]; j++) {
+        p[j] += p[j - 1];
+      }
+      p += counts[i];
+    }
+  } else {
+    std::copy(tail_positions_, tail_positions_ + total, positions->begin());
+  }
+}
+
+size_t PostingListView::block_size(size_t b) const {
+  // Every block but the last one is full
+  return std::min(kPostingBlockSize, size_ - b * kPostingBlockSize);
+}
+
+size_t PostingListView::find_block(size_t from, DocId doc_id) const {
+  size_t nb = num_blocks();
+  if (from >= nb || block_max(from) >= doc_id) {
+    return from;
+  }
+
+  // Gallop to bracket the block, then binary search the last step
+  size_t lo = from + 1;
+  size_t hi = lo;
+  size_t step = 1;
+  while (hi < nb && block_max(hi) < doc_id) {
+    lo = hi + 1;
+    hi += step;
+    step *= 2;
+  }
+  hi = std::min(hi, nb);
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (block_max(mid) < doc_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PostingListView::Cursor
+///////////////////////////////////////////////////////////////////////////////
+PostingListView::Cursor::Cursor(const PostingListView& list)
+    : list_(list), num_blocks_(list.num_blocks()), block_(0), pos_(0),
+      len_(0), counts_loaded_(false), positions_loaded_(false) {
+  if (!done()) {
+    load_block();
+  }
+}
+
+uint32_t PostingListView::Cursor::count() {
+  if (!counts_loaded_) {
+    list_.decode_counts(block_, counts_);
+    counts_loaded_ = true;
+  }
+  return counts_[pos_];
+}
+
+const uint32_t* PostingListView::Cursor::positions() {
+  if (!positions_loaded_) {
+    count();
+    list_.decode_positions(block_, counts_, &positions_);
+    uint32_t start = 0;
+    for (size_t i = 0; i < len_; i++) {
+      position_starts_[i] = start;
+      start += counts_[i];
+    }
+    positions_loaded_ = true;
+  }
+  return positions_.data() + position_starts_[pos_];
+}
+
+void PostingListView::Cursor::next() {
+  pos_++;
+  if (pos_ == len_) {
+    block_++;
+    if (!done()) {
+      load_block();
+    }
+  }
+}
+
+bool PostingListView::Cursor::seek(DocId doc_id) {
+  if (done()) {
+    return false;
+  }
+
+  if (list_.block_max(block_) < doc_id) {
+    block_ = list_.find_block(block_, doc_id);
+    if (done()) {
+      return false;
+    }
+    load_block();
+  }
+
+  // The current block holds a DocId >= doc_id, so this stays in bounds
+  if (doc_ids_[pos_] < doc_id) {
+    pos_ = std::lower_bound(doc_ids_ + pos_, doc_ids_ + len_, doc_id) -
+           doc_ids_;
+  }
+  return true;
+}
+
+void PostingListView::Cursor::load_block() {
+  len_ = list_.decode_doc_ids(block_, doc_ids_);
+  pos_ = 0;
+  counts_loaded_ = false;
+  positions_loaded_ = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PostingList
+///////////////////////////////////////////////////////////////////////////////
+PostingList::PostingList() : has_positions_(false), size_(0) { }
+
+PostingListView PostingList::view() const {
+  PostingListView list(blocks_.data(), blocks_.size(), data_.data(),
+                       tail_.data(), tail_.size(), size_,
+                       impacts_.empty() ? nullptr : impacts_.data());
+  if (has_positions_) {
+    list.set_positions(position_offsets_.data(), position_data_.data(),
+                       tail_positions_.data());
+  }
+  return list;
+}
+
+void PostingList::add(DocId doc_id, uint32_t count,
+                      const uint32_t* positions) {
+  impacts_.clear();
+  if (size_ == 0) {
+    has_positions_ = positions != nullptr;
+  } else if (positions == nullptr && has_positions_) {
+    drop_positions();
+  }
+  if (!has_positions_) {
+    positions = nullptr;
+  }
+
+  if (size_ > 0) {
+    DocId last = tail_.empty() ? blocks_.back().max_doc : tail_.back().doc_id;
+    if (doc_id == last) {
+      reopen_last_block();
+      tail_.back().count += count;
+      if (positions != nullptr) {
+        // Merge the new positions into the posting's
+        size_t end = tail_positions_.size();
+        tail_positions_.insert(tail_positions_.end(), positions,
+                               positions + count);
+        std::inplace_merge(
+            tail_positions_.end() - tail_.back().count,
+            tail_positions_.begin() + end, tail_positions_.end());
+      }
+      return;
+    }
+    if (doc_id < last) {
+      // Out of order; decode everything and rebuild the list around it
+      vector<Posting> postings;
+      vector<uint32_t> all_positions;
+      if (has_positions_) {
+        view().decode(&postings, &all_positions);
+      } else {
+        decode(&postings);
+      }
+      auto it = std::lower_bound(
+          postings.begin(), postings.end(), doc_id,
+          [](const Posting& p, DocId id) { return p.doc_id < id; });
+      size_t at = 0;
+      for (auto p = postings.begin(); p != it; ++p) {
+        at += p->count;
+      }
+      if (it != postings.end() && it->doc_id == doc_id) {
+        if (positions != nullptr) {
+          auto first = all_positions.begin() + at;
+          all_positions.insert(first + it->count, positions,
+                               positions + count);
+          first = all_positions.begin() + at;
+          std::inplace_merge(first, first + it->count,
+                             first + it->count + count);
+        }
+        it->count += count;
+      } else {
+        postings.insert(it, Posting{doc_id, count});
+        if (positions != nullptr) {
+          all_positions.insert(all_positions.begin() + at, positions,
+                               positions + count);
+        }
+      }
+
+      bool keep_positions = has_positions_;
+      blocks_.clear();
+      data_.clear();
+      tail_.clear();
+      position_offsets_.clear();
+      position_data_.clear();
+      tail_positions_.clear();
+      size_ = 0;
+      const uint32_t* p = all_positions.data();
+      for (const Posting& posting : postings) {
+        add(posting.doc_id, posting.count, keep_positions ? p : nullptr);
+        p += keep_positions ? posting.count : 0;
+      }
+      return;
+    }
+  }
+
+  // A partial block left behind by seal() has to be filled up first
+  if (tail_.empty() && !blocks_.empty() &&
+      block_size(blocks_.size() - 1) < kBlockSize) {
+    reopen_last_block();
+  }
+  if (tail_.size() == kBlockSize) {
+    flush_tail();
+  }
+  tail_.push_back(Posting{doc_id, count});
+  if (positions != nullptr) {
+    tail_positions_.insert(tail_positions_.end(), positions,
+                           positions + count);
+  }
+  size_++;
+}
+
+void PostingList::seal() {
+  if (!tail_.empty()) {
+    flush_tail();
+  }
+  tail_.shrink_to_fit();
+  blocks_.shrink_to_fit();
+  data_.shrink_to_fit();
+  tail_positions_.shrink_to_fit();
+  position_offsets_.shrink_to_fit();
+  position_data_.shrink_to_fit();
+}
+
+void PostingList::set_impacts(vector<uint8_t> impacts) {
+  impacts_ = std::move(impacts);
+}
+
+size_t PostingList::memory_bytes() const {
+  return sizeof(*this) + blocks_.capacity() * sizeof(BlockHeader) +
+         data_.capacity() + tail_.capacity() * sizeof(Posting) +
+         impacts_.capacity() +
+         position_offsets_.capacity() * sizeof(uint32_t) +
+         position_data_.capacity() +
+         tail_positions_.capacity() * sizeof(uint32_t);
+}
+
+void PostingList::flush_tail() {
+  DocId doc_ids[kBlockSize];
+  uint32_t counts[kBlockSize];
+  size_t n = tail_.size();
+  for (size_t i = 0; i < n; i++) {
+    doc_ids[i] = tail_[i].doc_id;
+    counts[i] = tail_[i].count;
+  }
+
+  // Drop the padding, append the block, then pad again
+  size_t offset =
+      blocks_.empty() ? 0 : data_.size() - kStreamVByteDecodePadding;
+  DocId prev = blocks_.empty() ? 0 : blocks_.back().max_doc;
+  data_.resize(offset + 2 * streamvbyte_max_bytes(n) +
+               kStreamVByteDecodePadding);
+  size_t len = streamvbyte_encode_delta(doc_ids, n, prev, &data_[offset]);
+  len += streamvbyte_encode(counts, n, &data_[offset + len]);
+  data_.resize(offset + len);
+  data_.resize(offset + len + kStreamVByteDecodePadding, 0);
+
+  blocks_.push_back(
+      BlockHeader{doc_ids[n - 1], static_cast<uint32_t>(offset)});
+  tail_.clear();
+
+  if (has_positions_) {
+    // Each posting's positions are stored as differences from the one
+    // before, starting over at every posting
+    vector<uint32_t> deltas(tail_positions_.size());
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+      for (size_t j = 0; j < counts[i]; j++, k++) {
+        deltas[k] = j == 0 ? tail_positions_[k]
+                           : tail_positions_[k] - tail_positions_[k - 1];
+      }
+    }
+
+    size_t poffset = position_offsets_.empty()
+                         ? 0
+                         : position_data_.size() - kStreamVByteDecodePadding;
+    position_data_.resize(poffset + streamvbyte_max_bytes(deltas.size()) +
+                          kStreamVByteDecodePadding);
+    size_t plen = streamvbyte_encode(deltas.data(), deltas.size(),
+                                     &position_data_[poffset]);
+    position_data_.resize(poffset + plen);
+    position_data_.resize(poffset + plen + kStreamVByteDecodePadding, 0);
+    position_offsets_.push_back(static_cast<uint32_t>(poffset));
+    tail_positions_.clear();
+  }
+}
+
+void PostingList::reopen_last_block() {
+  if (!tail_.empty() || blocks_.empty()) {
+    return;
+  }
+
+  size_t b = blocks_.size() - 1;
+  DocId doc_ids[kBlockSize];
+  uint32_t counts[kBlockSize];
+  PostingListView list = view();
+  size_t n = list.decode_doc_ids(b, doc_ids);
+  list.decode_counts(b, counts);
+  if (has_positions_) {
+    list.decode_positions(b, counts, &tail_positions_);
+    position_data_.resize(position_offsets_[b]);
+    if (b > 0) {
+      position_data_.resize(position_data_.size() + kStreamVByteDecodePadding,
+                            0);
+    }
+    position_offsets_.pop_back();
+  }
+
+  data_.resize(blocks_[b].offset);
+  if (b > 0) {
+    data_.resize(data_.size() + kStreamVByteDecodePadding, 0);
+  }
+  blocks_.pop_back();
+  for (size_t i = 0; i < n; i++) {
+    tail_.push_back(Posting{doc_ids[i], counts[i]});
+  }
+}
+
+size_t PostingList::data_bytes() const {
+  return blocks_.empty() ? 0 : data_.size() - kStreamVByteDecodePadding;
+}
+
+size_t PostingList::position_data_bytes() const {
+  return position_offsets_.empty()
+             ? 0
+             : position_data_.size() - kStreamVByteDecodePadding;
+}
+
+void PostingList::drop_positions() {
+  has_positions_ = false;
+  vector<uint32_t>().swap(position_offsets_);
+  vector<uint8_t>().swap(position_data_);
+  vector<uint32_t>().swap(tail_positions_);
+}
+
+size_t PostingList::block_size(size_t b) const {
+  // Every block but the last one is full
+  return std::min(kBlockSize, size_ - b * kBlockSize);
+}
+
+}  // namespace searchserver
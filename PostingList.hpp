@@ -0,0 +1,312 @@
+#ifndef POSTING_LIST_HPP_
+#define POSTING_LIST_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "./Result.hpp"
+
+using std::vector;
+
+namespace searchserver {
+
+// One entry in the posting list of a word: a document that contains
+// the word and how many times the word occurs in it
+struct Posting {
+  DocId doc_id;
+  uint32_t count;
+};
+
+// Where a compressed block of postings starts, relative to the start of
+// its list's compressed data, and the largest DocId in the block
+struct BlockHeader {
+  DocId max_doc;
+  uint32_t offset;
+};
+
+// The number of postings in every compressed block but the last one
+static constexpr size_t kPostingBlockSize = 128;
+
+// A PostingListView is a read-only view of the postings of one word,
+// sorted by DocId and stored in compressed blocks of kPostingBlockSize
+// postings.  Inside a block the DocIds are delta-encoded with StreamVByte,
+// followed by the counts in their own StreamVByte stream so that skipping
+// through a list never has to decode counts.  Every block also records its
+// largest DocId, which lets a Cursor skip whole blocks without decoding
+// them.  The last postings of a list may instead sit in an uncompressed
+// tail that is treated as one more block.
+//
+// A list may also hold the positions of every occurance of its word: a
+// posting with count c has c positions.  Those of a block are kept in a
+// separate area as one StreamVByte stream, each posting's positions
+// delta-encoded from its first, so that lookups which do not need them
+// never touch them.
+//
+// Views do not own any memory; they point into a PostingList that is
+// still being built or into the arrays of a FrozenIndex, and are cheap to
+// copy around.
+class PostingListView {
+ public:
+  class Cursor;
+
+  // Constructs a view of an empty list
+  PostingListView();
+
+  // Constructs a view of the "size" postings made up of the compressed
+  // blocks described by "blocks" (whose offsets are relative to "data"),
+  // followed by "tail_size" uncompressed postings at "tail".  "impacts"
+  // holds one quantized score per posting, or is nullptr.
+  PostingListView(const BlockHeader* blocks, size_t num_compressed,
+                  const uint8_t* data, const Posting* tail, size_t tail_size,
+                  size_t size, const uint8_t* impacts);
+
+  // Adds the positions to the view: where the positions of each compressed
+  // block start in "data" and the positions of the tail's postings, back
+  // to back
+  void set_positions(const uint32_t* block_offsets, const uint8_t* data,
+                     const uint32_t* tail);
+
+  // Returns the number of documents in the list
+  size_t size() const { return size_; }
+
+  // Returns true if the list has no documents
+  bool empty() const { return size_ == 0; }
+
+  // Decodes the whole list, appending every posting to "out"
+  void decode(vector<Posting>* out) const;
+
+  // Same as above, also appending the positions of every posting, in
+  // order, to "positions".  The list must have positions.
+  void decode(vector<Posting>* out, vector<uint32_t>* positions) const;
+
+  // Decodes the DocIds of the whole list, appending them to "out"
+  void decode_doc_ids(vector<DocId>* out) const;
+
+  // Intersects the sorted DocIds in "doc_ids" with this list, writing the
+  // DocIds found in both to "out".  Blocks that cannot hold any of the
+  // DocIds are skipped without being decoded, and each decoded block is
+  // intersected with the SIMD kernels in Intersect.hpp, or binary searched
+  // when only a few DocIds fall into it.
+  //
+  // Arguments:
+  //  - doc_ids, n: a sorted array of distinct DocIds and its length
+  //  - out: room for n DocIds.  May be the same array as doc_ids, or
+  //    overlap it as long as it starts no later than doc_ids
+  //
+  // Returns: the number of DocIds written to "out"
+  size_t intersect(const DocId* doc_ids, size_t n, DocId* out) const;
+
+  // Returns true if the list has a quantized score for every posting
+  bool has_impacts() const { return impacts_ != nullptr; }
+
+  // Returns the quantized score of the i'th posting in the list
+  uint8_t impact(size_t i) const { return impacts_[i]; }
+
+  // Returns true if the list has the positions of every posting
+  bool has_positions() const { return has_positions_; }
+
+  // Returns the number of blocks in the list, counting the tail as a block
+  size_t num_blocks() const {
+    return num_compressed_ + (tail_size_ == 0 ? 0 : 1);
+  }
+
+  // Returns the largest DocId in block b
+  DocId block_max(size_t b) const {
+    return b < num_compressed_ ? blocks_[b].max_doc
+                               : tail_[tail_size_ - 1].doc_id;
+  }
+
+  // Decodes the DocIds of block b into "doc_ids", which must have room for
+  // kPostingBlockSize entries.  Returns the number of postings in the block.
+  size_t decode_doc_ids(size_t b, DocId* doc_ids) const;
+
+  // Decodes the counts of block b into "counts", which must have room for
+  // kPostingBlockSize entries.  Returns the number of postings in the block.
+  size_t decode_counts(size_t b, uint32_t* counts) const;
+
+  // Decodes the positions of block b, whose counts are "counts", into
+  // "positions", which is resized to hold them: first every position of
+  // the block's first posting in increasing order, then those of the
+  // second, and so on.  The list must have positions.
+  void decode_positions(size_t b, const uint32_t* counts,
+                        vector<uint32_t>* positions) const;
+
+ private:
+  // Returns the number of postings in block b
+  size_t block_size(size_t b) const;
+
+  // Returns the first block at or after block "from" whose largest DocId
+  // is at least doc_id, or num_blocks() if there is none.  Gallops over
+  // the block maxima so that both short and long jumps are cheap.
+  size_t find_block(size_t from, DocId doc_id) const;
+
+  const BlockHeader* blocks_;
+  size_t num_compressed_;
+  const uint8_t* data_;
+  const Posting* tail_;
+  size_t tail_size_;
+  size_t size_;
+  const uint8_t* impacts_;
+  bool has_positions_;
+  const uint32_t* position_offsets_;
+  const uint8_t* position_data_;
+  const uint32_t* tail_positions_;
+};
+
+// A Cursor walks forward through a posting list, decoding at most one block
+// at a time.  Counts are only decoded when count() is called.
+class PostingListView::Cursor {
+ public:
+  // Constructs a cursor positioned on the first posting of "list"
+  explicit Cursor(const PostingListView& list);
+
+  // Returns true if the cursor has moved past the last posting
+  bool done() const { return block_ >= num_blocks_; }
+
+  // Returns the DocId of the current posting.  Must not be done()
+  DocId doc_id() const { return doc_ids_[pos_]; }
+
+  // Returns the count of the current posting.  Must not be done()
+  uint32_t count();
+
+  // Returns the positions of the current posting, count() of them in
+  // increasing order.  They stay valid until the cursor moves.  Must not
+  // be done() and the list must have positions.
+  const uint32_t* positions();
+
+  // Returns the position of the current posting in the list
+  size_t index() const { return block_ * kPostingBlockSize + pos_; }
+
+  // Moves to the next posting
+  void next();
+
+  // Moves forward to the first posting whose DocId is at least doc_id,
+  // skipping over every block whose largest DocId is smaller.
+  //
+  // Returns: false if there is no such posting, true otherwise
+  bool seek(DocId doc_id);
+
+ private:
+  // Decodes the DocIds of block_ and positions the cursor at its start
+  void load_block();
+
+  PostingListView list_;
+  size_t num_blocks_;
+  size_t block_;
+  size_t pos_;
+  size_t len_;
+  bool counts_loaded_;
+  bool positions_loaded_;
+  DocId doc_ids_[kPostingBlockSize];
+  uint32_t counts_[kPostingBlockSize];
+
+  // The positions of block_, and where each posting's start among them
+  vector<uint32_t> positions_;
+  uint32_t position_starts_[kPostingBlockSize];
+};
+
+// A PostingList builds up the postings of one word in the format described
+// above.  Postings are appended into an uncompressed tail which is
+// compressed once it fills up a block (or when seal() is called).
+class PostingList {
+ public:
+  static constexpr size_t kBlockSize = kPostingBlockSize;
+
+  // Constructs an empty PostingList
+  PostingList();
+
+  // Returns a view of the list.  The view is invalidated by add() and seal()
+  PostingListView view() const;
+
+  // Returns the number of documents in the list
+  size_t size() const { return size_; }
+
+  // Returns true if the list has no documents
+  bool empty() const { return size_ == 0; }
+
+  // Adds "count" occurances of the word in document doc_id.  Adding to the
+  // last document or to a new document past the end of the list is cheap;
+  // adding to a document in the middle of the list rebuilds the list.
+  //
+  // "positions" holds the positions of the "count" occurances in
+  // increasing order, or is nullptr.  The list keeps positions only as
+  // long as every posting added to it comes with them; the first one
+  // added without drops all of them.
+  void add(DocId doc_id, uint32_t count,
+           const uint32_t* positions = nullptr);
+
+  // Compresses the postings in the tail into a final, partial block and
+  // releases the tail's memory.  Call when no more postings are expected;
+  // add() still works afterwards.
+  void seal();
+
+  // Decodes the whole list, appending every posting to "out"
+  void decode(vector<Posting>* out) const { view().decode(out); }
+
+  // Stores a precomputed, quantized score for every posting in the list,
+  // in DocId order.  Adding to the list drops the scores again.
+  void set_impacts(vector<uint8_t> impacts);
+
+  // The raw parts of the list, for copying it into another layout: the
+  // block headers, the compressed blocks they point into (without the
+  // trailing decode padding) and the quantized scores, if any.  The
+  // tail must be empty, i.e. the list sealed, for these to be complete.
+  const vector<BlockHeader>& blocks() const { return blocks_; }
+  const uint8_t* data() const { return data_.data(); }
+  size_t data_bytes() const;
+  const vector<uint8_t>& impacts() const { return impacts_; }
+
+  // The same for the positions, if the list has them: where each block's
+  // positions start in the compressed positions, and those (again without
+  // padding)
+  bool has_positions() const { return has_positions_; }
+  const vector<uint32_t>& position_offsets() const {
+    return position_offsets_;
+  }
+  const uint8_t* position_data() const { return position_data_.data(); }
+  size_t position_data_bytes() const;
+
+  // Returns the number of bytes of memory held by the list
+  size_t memory_bytes() const;
+
+ private:
+  // Returns the number of postings in block b
+  size_t block_size(size_t b) const;
+
+  // Compresses the tail into a new block at the end of data_
+  void flush_tail();
+
+  // Decompresses the last block back into the (empty) tail
+  void reopen_last_block();
+
+  // Stops keeping positions and releases them
+  void drop_positions();
+
+  vector<BlockHeader> blocks_;
+
+  // The compressed blocks, back to back, followed by
+  // kStreamVByteDecodePadding zero bytes when there is at least one block
+  vector<uint8_t> data_;
+
+  // Postings not yet compressed into a block.  All of them have larger
+  // DocIds than any posting in a block.
+  vector<Posting> tail_;
+
+  // One quantized score per posting, or empty
+  vector<uint8_t> impacts_;
+
+  // Whether the list keeps positions, where the positions of each block
+  // start in position_data_, the compressed positions (padded like data_)
+  // and the positions of the postings in the tail, back to back
+  bool has_positions_;
+  vector<uint32_t> position_offsets_;
+  vector<uint8_t> position_data_;
+  vector<uint32_t> tail_positions_;
+
+  size_t size_;
+};
+
+}  // namespace searchserver
+
+#endif  // POSTING_LIST_HPP_
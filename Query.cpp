@@ -0,0 +1,143 @@
+#include "./Query.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace searchserver {
+
+// Splits a phrase into words at every non-letter
+static vector<string> split_phrase(const string& text) {
+  vector<string> words;
+  string word;
+  for (char c : text) {
+    if (isalpha(static_cast<unsigned char>(c)) != 0) {
+      word += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    } else if (!word.empty()) {
+      words.push_back(word);
+      word.clear();
+    }
+  }
+  if (!word.empty()) {
+    words.push_back(word);
+  }
+  return words;
+}
+
+// Parses a word, a prefix or a fuzzy term, adding it to "terms".  Returns
+// false if there is nothing to add
+static bool parse_term(string word, Terms* terms) {
+  for (char& c : word) {
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  }
+
+  size_t tilde = word.rfind('~');
+  if (word.size() > 1 && word.back() == '*') {
+    word.pop_back();
+    terms->prefixes.push_back(word);
+  } else if (tilde != string::npos && tilde > 0 &&
+             word.size() - tilde <= 2 &&
+             (tilde + 1 == word.size() || isdigit(word.back()) != 0)) {
+    int distance = tilde + 1 == word.size() ? kMaxFuzzyDistance
+                                            : word.back() - '0';
+    word.resize(tilde);
+    if (distance == 0) {
+      terms->words.push_back(word);
+    } else {
+      terms->fuzzy.push_back(
+          FuzzyTerm{word, std::min(distance, kMaxFuzzyDistance)});
+    }
+  } else if (!word.empty() && word != "*") {
+    terms->words.push_back(word);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Appends the words, prefixes and fuzzy terms in "from" to the others
+static void append_terms(const Terms& from, vector<string>* words,
+                         vector<string>* prefixes, vector<FuzzyTerm>* fuzzy) {
+  words->insert(words->end(), from.words.begin(), from.words.end());
+  prefixes->insert(prefixes->end(), from.prefixes.begin(),
+                   from.prefixes.end());
+  fuzzy->insert(fuzzy->end(), from.fuzzy.begin(), from.fuzzy.end());
+}
+
+Query parse_query(const string& text) {
+  Query query;
+
+  // The terms not in a phrase, in order, and whether an OR came after each
+  vector<Terms> terms;
+  vector<bool> or_after;
+
+  size_t i = 0;
+  while (i < text.size()) {
+    if (text[i] == ' ') {
+      i++;
+      continue;
+    }
+
+    if (text[i] == '"') {
+      size_t end = text.find('"', i + 1);
+      if (end == string::npos) {
+        end = text.size();
+      }
+      vector<string> phrase = split_phrase(text.substr(i + 1, end - i - 1));
+      if (phrase.size() == 1) {
+        query.words.push_back(phrase[0]);
+      } else if (phrase.size() > 1) {
+        query.phrases.push_back(phrase);
+      }
+      // A phrase cannot be an alternative, so it ends any group of them
+      if (!or_after.empty()) {
+        or_after.back() = false;
+      }
+      i = end + 1;
+      continue;
+    }
+
+    size_t end = text.find_first_of(" \"", i);
+    if (end == string::npos) {
+      end = text.size();
+    }
+    string word = text.substr(i, end - i);
+    i = end;
+
+    Terms term;
+    if (word == "OR") {
+      if (!or_after.empty()) {
+        or_after.back() = true;
+      }
+    } else if (word[0] == '-') {
+      parse_term(word.substr(1), &query.excluded);
+      if (!or_after.empty()) {
+        or_after.back() = false;
+      }
+    } else if (parse_term(word, &term)) {
+      terms.push_back(term);
+      or_after.push_back(false);
+    }
+  }
+
+  // Join the runs of terms with ORs between them into groups
+  if (!or_after.empty()) {
+    or_after.back() = false;
+  }
+  for (size_t j = 0; j < terms.size(); j++) {
+    if (!or_after[j]) {
+      append_terms(terms[j], &query.words, &query.prefixes, &query.fuzzy);
+      continue;
+    }
+    Terms group;
+    for (; j < terms.size(); j++) {
+      append_terms(terms[j], &group.words, &group.prefixes, &group.fuzzy);
+      if (!or_after[j]) {
+        break;
+      }
+    }
+    query.any.push_back(group);
+  }
+  return query;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,87 @@
+#ifndef QUERY_HPP_
+#define QUERY_HPP_
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// The largest edit distance a fuzzy term can ask for
+constexpr int kMaxFuzzyDistance = 2;
+
+// A term to match approximately: any word within "distance" edits
+// (inserted, deleted or replaced letters) of "word"
+struct FuzzyTerm {
+  string word;
+  int distance;
+};
+
+// A set of words, prefixes and fuzzy terms, which together stand for
+// every word in the index that is one of the words, starts with one of the
+// prefixes or is close to one of the fuzzy terms
+struct Terms {
+  vector<string> words;
+  vector<string> prefixes;
+  vector<FuzzyTerm> fuzzy;
+
+  // Returns true if there are no terms
+  bool empty() const {
+    return words.empty() && prefixes.empty() && fuzzy.empty();
+  }
+};
+
+// A parsed search query.  A document matches if it contains every word
+// and every phrase, some word starting with every prefix and close to
+// every fuzzy term, and some word of every group of alternatives, but
+// none of the excluded words.
+struct Query {
+  // Words the document must contain
+  vector<string> words;
+
+  // Phrases the document must contain, each a run of words that must
+  // occur next to each other and in this order
+  vector<vector<string>> phrases;
+
+  // Prefixes the document must contain a word starting with
+  vector<string> prefixes;
+
+  // Fuzzy terms the document must contain a word close to
+  vector<FuzzyTerm> fuzzy;
+
+  // Groups of alternatives the document must contain at least one of
+  vector<Terms> any;
+
+  // What the document must not contain
+  Terms excluded;
+
+  // Returns true if there is nothing to look up.  Exclusions alone do not
+  // match anything
+  bool empty() const {
+    return words.empty() && phrases.empty() && prefixes.empty() &&
+           fuzzy.empty() && any.empty();
+  }
+};
+
+// Parses the text of a search query.  Words are separated by spaces and
+// a phrase is written in double quotes, e.g.
+//
+//   fox "quick brown" jump* lazzy~ cat OR dog -bird
+//
+// where a word ending in '*' is a prefix (a lone '*' is ignored) and one
+// ending in '~' is a fuzzy term.  A fuzzy term matches words up to two
+// edits away, or up to N with '~N', where N is at most kMaxFuzzyDistance.
+// Words, prefixes and fuzzy terms joined by an upper-case OR are a group
+// of alternatives, and one starting with '-' is excluded; an OR that does
+// not join two of them is ignored.  Everything else is lower-cased.
+// Inside a phrase every non-letter separates words, the same way
+// documents are split into words when they are indexed; a phrase of a
+// single word is just a word, and a missing closing quote ends the phrase
+// at the end of the text.
+Query parse_query(const string& text);
+
+}  // namespace searchserver
+
+#endif  // QUERY_HPP_
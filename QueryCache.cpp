@@ -0,0 +1,178 @@
+#include "./QueryCache.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace searchserver {
+
+// Holds a mutex for as long as it is in scope
+class MutexGuard {
+ public:
+  explicit MutexGuard(pthread_mutex_t* lock) : lock_(lock) {
+    pthread_mutex_lock(lock_);
+  }
+  ~MutexGuard() { pthread_mutex_unlock(lock_); }
+
+ private:
+  pthread_mutex_t* lock_;
+};
+
+// Sorts "items" and removes the duplicates
+template <typename T>
+static void normalize(vector<T>* items) {
+  std::sort(items->begin(), items->end());
+  items->erase(std::unique(items->begin(), items->end()), items->end());
+}
+
+// Appends a string to a key, prefixed by its length so that no two lists
+// of strings append the same bytes
+static void append(const string& s, string* key) {
+  *key += std::to_string(s.size());
+  *key += ':';
+  *key += s;
+}
+
+// Returns the normalized form of a set of terms
+static string terms_key(const Terms& terms) {
+  vector<string> words = terms.words;
+  vector<string> prefixes = terms.prefixes;
+  vector<std::pair<string, int>> fuzzy;
+  for (const FuzzyTerm& term : terms.fuzzy) {
+    fuzzy.emplace_back(term.word, term.distance);
+  }
+  normalize(&words);
+  normalize(&prefixes);
+  normalize(&fuzzy);
+
+  string key = "w" + std::to_string(words.size());
+  for (const string& word : words) {
+    append(word, &key);
+  }
+  key += "p" + std::to_string(prefixes.size());
+  for (const string& prefix : prefixes) {
+    append(prefix, &key);
+  }
+  key += "f" + std::to_string(fuzzy.size());
+  for (const auto& term : fuzzy) {
+    append(term.first, &key);
+    key += std::to_string(term.second);
+  }
+  return key;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// QueryCache
+///////////////////////////////////////////////////////////////////////////////
+QueryCache::QueryCache(size_t capacity)
+    : shard_capacity_((capacity + kNumShards - 1) / kNumShards) {
+  for (Shard& shard : shards_) {
+    pthread_mutex_init(&shard.lock, nullptr);
+  }
+}
+
+QueryCache::~QueryCache() {
+  for (Shard& shard : shards_) {
+    pthread_mutex_destroy(&shard.lock);
+  }
+}
+
+bool QueryCache::lookup(const Query& query, size_t k, size_t offset,
+                        uint64_t generation, vector<Result>* results,
+                        size_t* num_results) {
+  if (shard_capacity_ == 0) {
+    return false;
+  }
+
+  string key = this->key(query, k, offset);
+  Shard& shard = shard_of(key);
+  MutexGuard guard(&shard.lock);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return false;
+  }
+
+  // An entry from another generation will never be served again
+  list<Entry>::iterator entry = it->second;
+  if (entry->generation != generation) {
+    shard.index.erase(it);
+    shard.entries.erase(entry);
+    return false;
+  }
+
+  shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+  *results = entry->results;
+  *num_results = entry->num_results;
+  return true;
+}
+
+void QueryCache::insert(const Query& query, size_t k, size_t offset,
+                        uint64_t generation, const vector<Result>& results,
+                        size_t num_results) {
+  if (shard_capacity_ == 0) {
+    return;
+  }
+
+  string key = this->key(query, k, offset);
+  Shard& shard = shard_of(key);
+  MutexGuard guard(&shard.lock);
+
+  // Replace any older copy, e.g. from an earlier generation
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    list<Entry>::iterator entry = it->second;
+    shard.index.erase(it);
+    shard.entries.erase(entry);
+  }
+
+  if (shard.entries.size() >= shard_capacity_) {
+    shard.index.erase(shard.entries.back().key);
+    shard.entries.pop_back();
+  }
+
+  shard.entries.push_front(
+      Entry{std::move(key), generation, results, num_results});
+  shard.index[shard.entries.front().key] = shard.entries.begin();
+}
+
+string QueryCache::key(const Query& query, size_t k, size_t offset) {
+  Terms all;
+  all.words = query.words;
+  all.prefixes = query.prefixes;
+  all.fuzzy = query.fuzzy;
+
+  vector<string> phrases;
+  for (const vector<string>& phrase : query.phrases) {
+    string phrase_key = std::to_string(phrase.size());
+    for (const string& word : phrase) {
+      append(word, &phrase_key);
+    }
+    phrases.push_back(phrase_key);
+  }
+  vector<string> groups;
+  for (const Terms& group : query.any) {
+    groups.push_back(terms_key(group));
+  }
+  normalize(&phrases);
+  normalize(&groups);
+
+  string key = std::to_string(k) + "," + std::to_string(offset) + ",";
+  key += terms_key(all);
+  key += "q" + std::to_string(phrases.size());
+  for (const string& phrase : phrases) {
+    append(phrase, &key);
+  }
+  key += "a" + std::to_string(groups.size());
+  for (const string& group : groups) {
+    append(group, &key);
+  }
+  key += "x";
+  key += terms_key(query.excluded);
+  return key;
+}
+
+QueryCache::Shard& QueryCache::shard_of(const string& key) {
+  return shards_[std::hash<string>()(key) % kNumShards];
+}
+
+}  // namespace searchserver
@@ -0,0 +1,102 @@
+#ifndef QUERY_CACHE_HPP_
+#define QUERY_CACHE_HPP_
+
+extern "C" {
+  #include <pthread.h>  // for the shard mutexes
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "./Query.hpp"
+#include "./Result.hpp"
+
+using std::list;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace searchserver {
+
+// A QueryCache remembers the results of recent lookups so that a popular
+// query is only run against the index once.  Queries are keyed by their
+// normalized form (see key()), so "fox dog" and "dog  fox fox" share an
+// entry, and by the page asked for.
+//
+// Every entry is tagged with the index's generation (see
+// WordIndex::generation()) from before its lookup ran, and only served
+// while the index is still at that generation; any update to the index
+// invalidates the whole cache without touching it.
+//
+// The entries are split across kNumShards shards by the hash of their
+// key, each a least-recently-used list under its own mutex, so that
+// concurrent requests rarely wait on each other.  Safe to use from any
+// number of threads.
+class QueryCache {
+ public:
+  // The number of independently locked shards
+  static constexpr size_t kNumShards = 16;
+
+  // The number of entries cached unless configured otherwise
+  static constexpr size_t kDefaultCapacity = 4096;
+
+  // Constructs a cache holding at most about "capacity" entries, spread
+  // evenly over the shards.  A capacity of 0 caches nothing.
+  explicit QueryCache(size_t capacity = kDefaultCapacity);
+  ~QueryCache();
+
+  // Looks up the page of "query" with "k" results per page starting at
+  // "offset", as cached at "generation".  Returns false if it is not
+  // cached, or was cached at another generation; otherwise returns true
+  // along with the page and the total number of results through
+  // "results" and "num_results".
+  bool lookup(const Query& query, size_t k, size_t offset,
+              uint64_t generation, vector<Result>* results,
+              size_t* num_results);
+
+  // Caches a page of results for "query" that was looked up after the
+  // index was at "generation", evicting the shard's least recently used
+  // entry if it is full
+  void insert(const Query& query, size_t k, size_t offset,
+              uint64_t generation, const vector<Result>& results,
+              size_t num_results);
+
+  // Returns the normalized form of a query: each kind of term sorted with
+  // duplicates removed, along with the page parameters
+  static string key(const Query& query, size_t k, size_t offset);
+
+  // delete cctor and op=
+  QueryCache(const QueryCache& other) = delete;
+  QueryCache& operator=(const QueryCache& other) = delete;
+
+ private:
+  struct Entry {
+    string key;
+    uint64_t generation;
+    vector<Result> results;
+    size_t num_results;
+  };
+
+  // One shard of the entries, most recently used first.  The map's keys
+  // point into the entries.  "lock" guards everything else.
+  struct Shard {
+    pthread_mutex_t lock;
+    list<Entry> entries;
+    unordered_map<std::string_view, list<Entry>::iterator> index;
+  };
+
+  // Returns the shard "key" belongs to
+  Shard& shard_of(const string& key);
+
+  Shard shards_[kNumShards];
+  size_t shard_capacity_;
+};
+
+}  // namespace searchserver
+
+#endif  // QUERY_CACHE_HPP_
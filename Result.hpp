@@ -1,27 +1,35 @@
 #ifndef RESULT_HPP_
 #define RESULT_HPP_
 
-#include <string>
-
-using std::string;
+#include <cstdint>
 
 namespace searchserver {
 
+// Documents are identified inside the index by a dense 32-bit id handed
+// out in the order the documents are first seen.  The WordIndex doc table
+// maps an id back to the name of the document.
+typedef uint32_t DocId;
+
 // This class represents a Result from looking up in the index
-// It contains a document name and a rank which is typically the
-// number of times certain word(s) show up in the document
+// It contains a document id and a rank which is typically the
+// BM25 score of certain word(s) in the document.
+// The name of the document can be recovered with WordIndex::doc_name()
 struct Result {
  public:
-  string doc_name;
-  int rank;
+  DocId doc_id;
+  float rank;
 
-  Result() : doc_name(""), rank(0) { }
+  Result() : doc_id(0), rank(0) { }
 
-  Result(string doc_name, int rank) : doc_name(doc_name), rank(rank) { }
+  Result(DocId doc_id, float rank) : doc_id(doc_id), rank(rank) { }
 
-  // Sort so that bibgger rank comes first
+  // Sort so that bibgger rank comes first.  Ties go to the smaller DocId
+  // so that the order (and so every page of results) is deterministic
   bool operator<(const Result& other) const {
-    return other.rank < this->rank;
+    if (other.rank != this->rank) {
+      return other.rank < this->rank;
+    }
+    return this->doc_id < other.doc_id;
   }
 
   // the synthtesized cctor and op= are fine here
@@ -0,0 +1,181 @@
+#include "./StreamVByte.hpp"
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace searchserver {
+
+//////////////////////////////////////////////////////////////////////////////
+// Internal helper functions and constants
+//////////////////////////////////////////////////////////////////////////////
+
+// For every possible control byte: the pshufb mask that spreads the
+// group's data bytes out into four 32-bit lanes (0xFF zeroes a byte), and
+// the total number of data bytes the group takes up
+struct DecodeTables {
+  uint8_t shuffle[256][16];
+  uint8_t length[256];
+};
+
+static constexpr DecodeTables make_decode_tables() {
+  DecodeTables tables{};
+  for (int key = 0; key < 256; key++) {
+    int pos = 0;
+    for (int i = 0; i < 4; i++) {
+      int len = ((key >> (2 * i)) & 3) + 1;
+      for (int b = 0; b < 4; b++) {
+        tables.shuffle[key][4 * i + b] =
+            b < len ? static_cast<uint8_t>(pos + b) : 0xFF;
+      }
+      pos += len;
+    }
+    tables.length[key] = static_cast<uint8_t>(pos);
+  }
+  return tables;
+}
+
+static constexpr DecodeTables kDecodeTables = make_decode_tables();
+
+// Returns the number of bytes (1 to 4) needed to store "value"
+static inline uint32_t byte_length(uint32_t value) {
+  if (value < (1U << 8)) {
+    return 1;
+  }
+  if (value < (1U << 16)) {
+    return 2;
+  }
+  if (value < (1U << 24)) {
+    return 3;
+  }
+  return 4;
+}
+
+// Shared encoder; stores differences from the previous value if "delta"
+static size_t encode(const uint32_t* in, size_t count, uint32_t prev,
+                     bool delta, uint8_t* out) {
+  uint8_t* control = out;
+  uint8_t* data = out + (count + 3) / 4;
+
+  for (size_t i = 0; i < count; i += 4) {
+    uint8_t key = 0;
+    for (size_t j = 0; j < 4 && i + j < count; j++) {
+      uint32_t value = in[i + j];
+      if (delta) {
+        value -= prev;
+        prev = in[i + j];
+      }
+      uint32_t len = byte_length(value);
+      key |= static_cast<uint8_t>((len - 1) << (2 * j));
+      memcpy(data, &value, len);
+      data += len;
+    }
+    *control++ = key;
+  }
+
+  return data - out;
+}
+
+// Decodes values [first, count) one at a time.  "data" points at the data
+// byte of value "first".  Returns a pointer just past the last data byte.
+static const uint8_t* decode_scalar(const uint8_t* control,
+                                    const uint8_t* data, size_t first,
+                                    size_t count, uint32_t prev, bool delta,
+                                    uint32_t* out) {
+  for (size_t i = first; i < count; i++) {
+    uint32_t len = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+    uint32_t value = 0;
+    memcpy(&value, data, len);
+    data += len;
+    if (delta) {
+      prev += value;
+      value = prev;
+    }
+    out[i] = value;
+  }
+  return data;
+}
+
+// Decodes whole groups of four with one shuffle each, then hands the
+// remaining (at most three) values to the scalar decoder
+__attribute__((target("ssse3"))) static const uint8_t* decode_ssse3(
+    const uint8_t* control, const uint8_t* data, size_t count, uint32_t prev,
+    bool delta, uint32_t* out) {
+  size_t groups = count / 4;
+  __m128i running = _mm_set1_epi32(static_cast<int>(prev));
+
+  for (size_t g = 0; g < groups; g++) {
+    uint8_t key = control[g];
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    __m128i mask = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(kDecodeTables.shuffle[key]));
+    __m128i values = _mm_shuffle_epi8(bytes, mask);
+    if (delta) {
+      // In-register prefix sum of the four lanes, plus the running total
+      values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+      values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+      values = _mm_add_epi32(values, running);
+      running = _mm_shuffle_epi32(values, 0xFF);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * g), values);
+    data += kDecodeTables.length[key];
+  }
+
+  prev = static_cast<uint32_t>(_mm_cvtsi128_si32(running));
+  return decode_scalar(control, data, groups * 4, count, prev, delta, out);
+}
+
+// Picks the fastest decoder the CPU supports
+static size_t decode(const uint8_t* in, size_t count, uint32_t prev,
+                     bool delta, uint32_t* out) {
+  static const bool have_ssse3 = __builtin_cpu_supports("ssse3");
+
+  const uint8_t* control = in;
+  const uint8_t* data = in + (count + 3) / 4;
+  const uint8_t* end;
+  if (have_ssse3) {
+    end = decode_ssse3(control, data, count, prev, delta, out);
+  } else {
+    end = decode_scalar(control, data, 0, count, prev, delta, out);
+  }
+  return end - in;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Externally-exported functions
+//////////////////////////////////////////////////////////////////////////////
+
+size_t streamvbyte_max_bytes(size_t count) {
+  return (count + 3) / 4 + 4 * count;
+}
+
+size_t streamvbyte_encode(const uint32_t* in, size_t count, uint8_t* out) {
+  return encode(in, count, 0, false, out);
+}
+
+size_t streamvbyte_encoded_bytes(const uint8_t* in, size_t count) {
+  size_t num_control = (count + 3) / 4;
+  size_t bytes = num_control;
+  for (size_t g = 0; g < count / 4; g++) {
+    bytes += kDecodeTables.length[in[g]];
+  }
+  for (size_t i = count / 4 * 4; i < count; i++) {
+    bytes += ((in[i / 4] >> (2 * (i % 4))) & 3) + 1;
+  }
+  return bytes;
+}
+
+size_t streamvbyte_decode(const uint8_t* in, size_t count, uint32_t* out) {
+  return decode(in, count, 0, false, out);
+}
+
+size_t streamvbyte_encode_delta(const uint32_t* in, size_t count,
+                                uint32_t prev, uint8_t* out) {
+  return encode(in, count, prev, true, out);
+}
+
+size_t streamvbyte_decode_delta(const uint8_t* in, size_t count,
+                                uint32_t prev, uint32_t* out) {
+  return decode(in, count, prev, true, out);
+}
+
+}  // namespace searchserver
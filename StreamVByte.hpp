@@ -0,0 +1,53 @@
+#ifndef STREAM_VBYTE_HPP_
+#define STREAM_VBYTE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace searchserver {
+
+// StreamVByte is a byte-oriented integer codec that is fast to decode
+// with SIMD shuffles.  Integers are encoded in groups of four: one control
+// byte holds four 2-bit lengths (1 to 4 bytes each) and the little-endian
+// value bytes follow in a separate data area.  An encoded stream of
+// "count" integers looks like:
+//
+//   [ceil(count / 4) control bytes][data bytes]
+//
+// Decoding uses an SSSE3 shuffle per group of four when the CPU supports
+// it and falls back to a scalar loop otherwise.
+
+// The decoder may load up to this many bytes past the end of the encoded
+// stream, so the buffer holding it must have that many readable bytes
+// after the stream.
+static constexpr size_t kStreamVByteDecodePadding = 16;
+
+// Returns the largest number of bytes encoding "count" integers can take
+size_t streamvbyte_max_bytes(size_t count);
+
+// Encodes the "count" integers in "in" into "out", which must have room for
+// streamvbyte_max_bytes(count) bytes.
+//
+// Returns: the number of bytes written to "out"
+size_t streamvbyte_encode(const uint32_t* in, size_t count, uint8_t* out);
+
+// Decodes "count" integers from "in" into "out".
+//
+// Returns: the number of bytes of "in" that made up the encoded stream
+size_t streamvbyte_decode(const uint8_t* in, size_t count, uint32_t* out);
+
+// Returns the number of bytes taken up by the encoded stream of "count"
+// integers at "in", reading only its control bytes
+size_t streamvbyte_encoded_bytes(const uint8_t* in, size_t count);
+
+// Same as above, but for sorted input: each integer is stored as the
+// difference from the one before it, and the first as the difference
+// from "prev".  The decoder adds the differences back up.
+size_t streamvbyte_encode_delta(const uint32_t* in, size_t count,
+                                uint32_t prev, uint8_t* out);
+size_t streamvbyte_decode_delta(const uint8_t* in, size_t count,
+                                uint32_t prev, uint32_t* out);
+
+}  // namespace searchserver
+
+#endif  // STREAM_VBYTE_HPP_
@@ -0,0 +1,212 @@
+#include "./TermDictionary.hpp"
+
+#include <algorithm>
+
+namespace searchserver {
+
+// Appends "value" to "out" as a LEB128 varint
+static void put_varint(uint32_t value, vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a LEB128 varint at "*p", advancing "*p" past it
+static uint32_t get_varint(const uint8_t** p) {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *(*p)++;
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return value;
+    }
+  }
+}
+
+// Same as above, but fails instead of reading at or past "end" or
+// decoding a value that does not fit in 32 bits
+static bool get_varint_checked(const uint8_t** p, const uint8_t* end,
+                               uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*p >= end) {
+      return false;
+    }
+    uint8_t byte = *(*p)++;
+    *value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// TermDictionary
+///////////////////////////////////////////////////////////////////////////////
+TermDictionary::TermDictionary()
+    : bytes_(nullptr), num_bytes_(0), bucket_offsets_(nullptr),
+      num_buckets_(0), num_terms_(0) { }
+
+void TermDictionary::add(std::string_view term) {
+  if (num_terms_ % kBucketSize == 0) {
+    bucket_offsets_storage_.push_back(
+        static_cast<uint32_t>(bytes_storage_.size()));
+    put_varint(static_cast<uint32_t>(term.size()), &bytes_storage_);
+    bytes_storage_.insert(bytes_storage_.end(), term.begin(), term.end());
+  } else {
+    size_t shared = std::mismatch(last_.begin(), last_.end(), term.begin(),
+                                  term.end()).first - last_.begin();
+    put_varint(static_cast<uint32_t>(shared), &bytes_storage_);
+    put_varint(static_cast<uint32_t>(term.size() - shared), &bytes_storage_);
+    bytes_storage_.insert(bytes_storage_.end(), term.begin() + shared,
+                          term.end());
+  }
+  last_.assign(term);
+  num_terms_++;
+}
+
+void TermDictionary::finish() {
+  bytes_storage_.shrink_to_fit();
+  bucket_offsets_storage_.shrink_to_fit();
+  string().swap(last_);
+
+  bytes_ = bytes_storage_.data();
+  num_bytes_ = bytes_storage_.size();
+  bucket_offsets_ = bucket_offsets_storage_.data();
+  num_buckets_ = bucket_offsets_storage_.size();
+}
+
+void TermDictionary::save(IndexFileWriter* writer) const {
+  writer->add_section(kSectionTermBytes, bytes_, num_bytes_);
+  writer->add_section(kSectionTermBucketOffsets, bucket_offsets_,
+                      num_buckets_ * sizeof(uint32_t));
+}
+
+bool TermDictionary::load(const IndexFileReader& reader, size_t num_terms) {
+  const void* bytes;
+  const void* bucket_offsets;
+  if (!reader.section(kSectionTermBytes, 0, &bytes, &num_bytes_) ||
+      !reader.section(kSectionTermBucketOffsets, sizeof(uint32_t),
+                      &bucket_offsets, &num_buckets_) ||
+      num_buckets_ != (num_terms + kBucketSize - 1) / kBucketSize) {
+    return false;
+  }
+  bytes_ = static_cast<const uint8_t*>(bytes);
+  bucket_offsets_ = static_cast<const uint32_t*>(bucket_offsets);
+  num_terms_ = num_terms;
+
+  // Decode every term once, checking that nothing points out of bounds,
+  // that the buckets start where the offsets say and that the terms are
+  // sorted
+  const uint8_t* p = bytes_;
+  const uint8_t* end = bytes_ + num_bytes_;
+  string prev;
+  string term;
+  for (size_t i = 0; i < num_terms_; i++) {
+    uint32_t shared = 0;
+    uint32_t len;
+    if (i % kBucketSize == 0) {
+      if (p != bytes_ + bucket_offsets_[i / kBucketSize]) {
+        return false;
+      }
+    } else if (!get_varint_checked(&p, end, &shared) ||
+               shared > term.size()) {
+      return false;
+    }
+    if (!get_varint_checked(&p, end, &len) ||
+        len > static_cast<size_t>(end - p)) {
+      return false;
+    }
+    term.resize(shared);
+    term.append(reinterpret_cast<const char*>(p), len);
+    p += len;
+    if (i > 0 && term <= prev) {
+      return false;
+    }
+    prev = term;
+  }
+  return p == end;
+}
+
+bool TermDictionary::find(std::string_view term, size_t* index) const {
+  Iterator it = lower_bound(term);
+  if (it.done() || it.term() != term) {
+    return false;
+  }
+  *index = it.index();
+  return true;
+}
+
+TermDictionary::Iterator TermDictionary::lower_bound(
+    std::string_view term) const {
+  // Find the last bucket whose first term is not greater than "term"
+  size_t lo = 0;
+  size_t hi = num_buckets_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (bucket_head(mid) <= term) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // The term is in that bucket, or is the first term of the next one
+  Iterator it(this, lo == 0 ? 0 : lo - 1);
+  while (!it.done() && it.term() < term) {
+    it.next();
+  }
+  return it;
+}
+
+TermDictionary::Iterator TermDictionary::at(size_t i) const {
+  Iterator it(this, i / kBucketSize);
+  for (size_t j = 0; j < i % kBucketSize; j++) {
+    it.next();
+  }
+  return it;
+}
+
+size_t TermDictionary::memory_bytes() const {
+  return sizeof(*this) + bytes_storage_.capacity() +
+         bucket_offsets_storage_.capacity() * sizeof(uint32_t);
+}
+
+std::string_view TermDictionary::bucket_head(size_t b) const {
+  const uint8_t* p = bytes_ + bucket_offsets_[b];
+  uint32_t len = get_varint(&p);
+  return std::string_view(reinterpret_cast<const char*>(p), len);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// TermDictionary::Iterator
+///////////////////////////////////////////////////////////////////////////////
+TermDictionary::Iterator::Iterator(const TermDictionary* dict, size_t bucket)
+    : dict_(dict), index_(bucket * kBucketSize), pos_(nullptr) {
+  if (!done()) {
+    pos_ = dict_->bytes_ + dict_->bucket_offsets_[bucket];
+    uint32_t len = get_varint(&pos_);
+    term_.assign(reinterpret_cast<const char*>(pos_), len);
+    pos_ += len;
+  }
+}
+
+void TermDictionary::Iterator::next() {
+  index_++;
+  if (done()) {
+    return;
+  }
+
+  // Buckets are stored back to back, so the next term always starts
+  // where this one ended
+  uint32_t shared = index_ % kBucketSize == 0 ? 0 : get_varint(&pos_);
+  uint32_t len = get_varint(&pos_);
+  term_.resize(shared);
+  term_.append(reinterpret_cast<const char*>(pos_), len);
+  pos_ += len;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,124 @@
+#ifndef TERM_DICTIONARY_HPP_
+#define TERM_DICTIONARY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./IndexFile.hpp"
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// A TermDictionary is a sorted, front-coded array of terms.  The terms
+// are split into buckets of kBucketSize.  The first term of a bucket is
+// stored in full; every other term is stored as the length of the prefix
+// it shares with the term before it followed by the rest of its bytes:
+//
+//   bucket: [len][bytes] ([shared][len][suffix bytes]) * (kBucketSize - 1)
+//
+// with every length a LEB128 varint.  Sorted terms share long prefixes,
+// so this takes a fraction of the space of storing them whole, while a
+// lookup is still a binary search over the bucket heads followed by a
+// scan of at most one bucket.  Terms are numbered by their position in
+// sorted order.
+//
+// Like FrozenIndex, a TermDictionary is read-only once built, and its
+// arrays can be saved to and served straight out of an index file.
+class TermDictionary {
+ public:
+  class Iterator;
+
+  // The number of terms per bucket
+  static constexpr size_t kBucketSize = 16;
+
+  // Constructs an empty dictionary
+  TermDictionary();
+
+  // Appends a term while building.  Terms must be added in strictly
+  // increasing order
+  void add(std::string_view term);
+
+  // Finishes building.  Must be called once, after every term has been
+  // added and before anything is looked up
+  void finish();
+
+  // Adds the dictionary's arrays to "writer" as sections.  The dictionary
+  // must outlive the writer's write()
+  void save(IndexFileWriter* writer) const;
+
+  // Serves the dictionary out of the sections of a mapped index file,
+  // after checking that they decode to "num_terms" sorted terms.  "reader"
+  // must outlive the dictionary.  Returns false if they do not.
+  bool load(const IndexFileReader& reader, size_t num_terms);
+
+  // Returns the number of terms
+  size_t size() const { return num_terms_; }
+
+  // Looks up a term.  Returns false if it is not in the dictionary,
+  // otherwise returns true and its number through "index"
+  bool find(std::string_view term, size_t* index) const;
+
+  // Returns an iterator positioned on the first term that is not less
+  // than "term", which is done() if there is none
+  Iterator lower_bound(std::string_view term) const;
+
+  // Returns an iterator positioned on the i'th term
+  Iterator at(size_t i) const;
+
+  // Returns the number of bytes of heap memory held by the dictionary
+  size_t memory_bytes() const;
+
+ private:
+  // Returns the first term of bucket b
+  std::string_view bucket_head(size_t b) const;
+
+  // The arrays lookups read from, pointing into the vectors below or into
+  // a mapped file
+  const uint8_t* bytes_;
+  size_t num_bytes_;
+  const uint32_t* bucket_offsets_;
+  size_t num_buckets_;
+  size_t num_terms_;
+
+  // Storage while building, and the last term added
+  vector<uint8_t> bytes_storage_;
+  vector<uint32_t> bucket_offsets_storage_;
+  string last_;
+};
+
+// An Iterator walks the terms of a TermDictionary in sorted order,
+// decoding each one from the one before it
+class TermDictionary::Iterator {
+ public:
+  // Returns true if the iterator has moved past the last term
+  bool done() const { return index_ >= dict_->num_terms_; }
+
+  // Returns the current term.  Only valid until the iterator moves.
+  // Must not be done()
+  std::string_view term() const { return term_; }
+
+  // Returns the number of the current term
+  size_t index() const { return index_; }
+
+  // Moves to the next term
+  void next();
+
+ private:
+  friend class TermDictionary;
+
+  Iterator(const TermDictionary* dict, size_t bucket);
+
+  const TermDictionary* dict_;
+  size_t index_;
+  const uint8_t* pos_;
+  string term_;
+};
+
+}  // namespace searchserver
+
+#endif  // TERM_DICTIONARY_HPP_
@@ -0,0 +1,231 @@
+#ifndef TERM_MAP_HPP_
+#define TERM_MAP_HPP_
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using std::vector;
+
+namespace searchserver {
+
+// A TermMap maps terms to values of type V.  It is a flat open-addressing
+// hash table in the style of a Swiss table, built for the mutable part of
+// the index, where every posting added means a lookup:
+//
+//  - The entries (a key and its value) are stored back to back in one
+//    vector, in the order they were added, which is also the order they
+//    are iterated in.
+//  - The table itself is two parallel arrays: a control byte per slot,
+//    holding 7 bits of the key's hash or kEmpty, and the index of the
+//    slot's entry.  The slots are probed 16 at a time by comparing the
+//    16 control bytes of a group against the hash with one SSE2
+//    instruction, so most probes touch one cache line of control bytes
+//    and only compare keys whose hash bits already match.
+//  - The bytes of the keys are copied into an arena of large chunks
+//    rather than allocated one string at a time, and are never moved, so
+//    each entry's key is a string_view that stays valid until clear().
+//
+// Lookups take a string_view, so callers never build a string to probe.
+// Entries can only be added; clear() drops all of them.  Adding an entry
+// may move the others, so references to values only stay valid until the
+// next insertion.
+template <typename V>
+class TermMap {
+ public:
+  // A key and its value.  Named like the members of a std::pair so that
+  // loops over a TermMap read like loops over a std::unordered_map
+  struct Entry {
+    std::string_view first;
+    V second;
+  };
+
+  using iterator = typename vector<Entry>::iterator;
+  using const_iterator = typename vector<Entry>::const_iterator;
+
+  // The number of slots whose control bytes are compared at once
+  static constexpr size_t kGroupSize = 16;
+
+  TermMap() : size_mask_(0), chunk_used_(0) { }
+  TermMap(TermMap&& other) = default;
+  TermMap& operator=(TermMap&& other) = default;
+
+  // Returns the number of entries
+  size_t size() const { return entries_.size(); }
+
+  // Returns true if there are no entries
+  bool empty() const { return entries_.empty(); }
+
+  // Returns the value of "key", or nullptr if it has none
+  V* find(std::string_view key) {
+    size_t slot;
+    return find_slot(key, hash(key), &slot) ? &entries_[slots_[slot]].second
+                                            : nullptr;
+  }
+  const V* find(std::string_view key) const {
+    size_t slot;
+    return find_slot(key, hash(key), &slot) ? &entries_[slots_[slot]].second
+                                            : nullptr;
+  }
+
+  // Returns the value of "key", adding a default-constructed one first if
+  // it has none
+  V& operator[](std::string_view key) {
+    uint64_t h = hash(key);
+    size_t slot;
+    if (find_slot(key, h, &slot)) {
+      return entries_[slots_[slot]].second;
+    }
+
+    // Keep at least one slot in eight empty so that probes stay short
+    if ((entries_.size() + 1) * 8 > ctrl_.size() * 7) {
+      grow();
+    }
+    place(h, static_cast<uint32_t>(entries_.size()));
+    entries_.push_back(Entry{store(key), V()});
+    return entries_.back().second;
+  }
+
+  // Iterates over the entries in the order they were added
+  iterator begin() { return entries_.begin(); }
+  iterator end() { return entries_.end(); }
+  const_iterator begin() const { return entries_.begin(); }
+  const_iterator end() const { return entries_.end(); }
+
+  // Drops every entry and releases all memory
+  void clear() { *this = TermMap(); }
+
+  // Returns the number of bytes of heap memory held by the map, not
+  // counting any held by the values
+  size_t memory_bytes() const {
+    size_t bytes = ctrl_.capacity() + slots_.capacity() * sizeof(uint32_t) +
+                   entries_.capacity() * sizeof(Entry);
+    for (const auto& chunk : chunks_) {
+      bytes += chunk.second;
+    }
+    return bytes;
+  }
+
+  // delete cctor and op=
+  TermMap(const TermMap& other) = delete;
+  TermMap& operator=(const TermMap& other) = delete;
+
+ private:
+  // The control byte of a slot with no entry.  A full slot's control byte
+  // is 7 bits of its key's hash, so it never has the top bit set
+  static constexpr int8_t kEmpty = -128;
+
+  // The sizes of the chunks the key bytes are copied into, which start
+  // small so that short-lived maps stay cheap and double from there
+  static constexpr size_t kMinChunkSize = 256;
+  static constexpr size_t kMaxChunkSize = 64 * 1024;
+
+  // Mixes the standard string hash so that all of its bits depend on the
+  // whole key, since callers may already have used its low bits to pick
+  // this map (see WordIndex::shard_of())
+  static uint64_t hash(std::string_view key) {
+    return std::hash<std::string_view>()(key) * 0x9e3779b97f4a7c15ull;
+  }
+
+  // The control byte of a key with hash "h"
+  static int8_t control(uint64_t h) { return static_cast<int8_t>(h >> 57); }
+
+  // Returns a bit mask of the slots in the group starting at "ctrl" whose
+  // control byte is "c"
+  static uint32_t match(const int8_t* ctrl, int8_t c) {
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c))));
+  }
+
+  // Probes the groups for "key", starting at the group picked by bits of
+  // "h" that do not overlap its control byte and moving on by 1, 2, 3...
+  // groups, which visits every group since there is a power of two of
+  // them.  Returns true and its slot through "slot" if it is found
+  bool find_slot(std::string_view key, uint64_t h, size_t* slot) const {
+    if (ctrl_.empty()) {
+      return false;
+    }
+    int8_t c = control(h);
+    size_t group = (h >> 32) & size_mask_ & ~(kGroupSize - 1);
+    for (size_t step = kGroupSize;; step += kGroupSize) {
+      for (uint32_t bits = match(&ctrl_[group], c); bits != 0;
+           bits &= bits - 1) {
+        size_t i = group + __builtin_ctz(bits);
+        if (entries_[slots_[i]].first == key) {
+          *slot = i;
+          return true;
+        }
+      }
+      // Nothing is ever removed, so an empty slot ends every probe
+      if (match(&ctrl_[group], kEmpty) != 0) {
+        return false;
+      }
+      group = (group + step) & size_mask_;
+    }
+  }
+
+  // Puts entry "index", whose key has hash "h", in the first empty slot
+  // on its probe sequence.  There must be one
+  void place(uint64_t h, uint32_t index) {
+    size_t group = (h >> 32) & size_mask_ & ~(kGroupSize - 1);
+    for (size_t step = kGroupSize;; step += kGroupSize) {
+      uint32_t empty = match(&ctrl_[group], kEmpty);
+      if (empty != 0) {
+        size_t i = group + __builtin_ctz(empty);
+        ctrl_[i] = control(h);
+        slots_[i] = index;
+        return;
+      }
+      group = (group + step) & size_mask_;
+    }
+  }
+
+  // Doubles the number of slots and puts every entry back
+  void grow() {
+    size_t num_slots = std::max(2 * ctrl_.size(), 2 * kGroupSize);
+    ctrl_.assign(num_slots, kEmpty);
+    slots_.assign(num_slots, 0);
+    size_mask_ = num_slots - 1;
+    for (size_t i = 0; i < entries_.size(); i++) {
+      place(hash(entries_[i].first), static_cast<uint32_t>(i));
+    }
+  }
+
+  // Copies "key" into the arena
+  std::string_view store(std::string_view key) {
+    if (chunks_.empty() || chunk_used_ + key.size() > chunks_.back().second) {
+      size_t size = chunks_.empty()
+                        ? kMinChunkSize
+                        : std::min(2 * chunks_.back().second, kMaxChunkSize);
+      size = std::max(size, key.size());
+      chunks_.emplace_back(std::make_unique_for_overwrite<char[]>(size), size);
+      chunk_used_ = 0;
+    }
+    char* bytes = chunks_.back().first.get() + chunk_used_;
+    memcpy(bytes, key.data(), key.size());
+    chunk_used_ += key.size();
+    return std::string_view(bytes, key.size());
+  }
+
+  vector<int8_t> ctrl_;
+  vector<uint32_t> slots_;
+  size_t size_mask_;
+  vector<Entry> entries_;
+
+  // The arena: chunks and their sizes, and how much of the last is used
+  vector<std::pair<std::unique_ptr<char[]>, size_t>> chunks_;
+  size_t chunk_used_;
+};
+
+}  // namespace searchserver
+
+#endif  // TERM_MAP_HPP_
@@ -0,0 +1,175 @@
+#include "./TextSniffer.hpp"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace searchserver {
+
+// The extensions of files that are never text, and of files that always
+// are, in sorted order
+static constexpr std::string_view kBinaryExtensions[] = {
+    "7z", "a", "avi", "bin", "bmp", "bz2", "class", "db", "dll", "dmg",
+    "docx", "dylib", "eot", "exe", "flac", "gif", "gz", "ico", "idx", "iso",
+    "jar", "jpeg", "jpg", "lz4", "mkv", "mov", "mp3", "mp4", "o", "obj",
+    "ogg", "otf", "pdf", "png", "pyc", "rar", "so", "sqlite", "tar", "tgz",
+    "tif", "tiff", "ttf", "wasm", "wav", "webm", "webp", "woff", "woff2",
+    "xlsx", "xz", "zip", "zst",
+};
+
+static constexpr std::string_view kTextExtensions[] = {
+    "c", "cc", "cfg", "conf", "cpp", "css", "csv", "go", "h", "hpp", "htm",
+    "html", "ini", "java", "js", "json", "log", "md", "py", "rs", "rst",
+    "sh", "tex", "toml", "ts", "txt", "xml", "yaml", "yml",
+};
+
+// The number of bytes classified at once, one per bit of the masks
+static constexpr size_t kChunkSize = 64;
+
+// A file is binary if more than one byte in this many is a control byte
+static constexpr size_t kControlRatio = 32;
+
+// The bytes of a chunk that text files don't have
+struct ChunkMasks {
+  uint64_t nul;
+  uint64_t control;
+};
+
+// Returns true if "c" is a control byte that text files don't have: below
+// ' ' but not whitespace or escape, or DEL
+static bool is_control(unsigned char c) {
+  return (c < 0x20 && !(c >= '\b' && c <= '\r') && c != 0x1b) || c == 0x7f;
+}
+
+static ChunkMasks classify_scalar(const char* text, size_t size) {
+  ChunkMasks masks{0, 0};
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == 0) {
+      masks.nul |= uint64_t{1} << i;
+    } else if (is_control(c)) {
+      masks.control |= uint64_t{1} << i;
+    }
+  }
+  return masks;
+}
+
+// Bytes compare as unsigned by way of the unsigned minimum: "x" is at most
+// "y" if min(x, y) is "x".  A byte is whitespace if subtracting '\b'
+// leaves at most '\r' - '\b'.
+static ChunkMasks classify_sse2(const char* text) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i last_low = _mm_set1_epi8(0x1f);
+  const __m128i backspace = _mm_set1_epi8('\b');
+  const __m128i space_range = _mm_set1_epi8('\r' - '\b');
+  const __m128i escape = _mm_set1_epi8(0x1b);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  ChunkMasks masks{0, 0};
+  for (size_t i = 0; i < kChunkSize; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+    __m128i nul = _mm_cmpeq_epi8(bytes, zero);
+    __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_low), bytes);
+    __m128i shifted = _mm_sub_epi8(bytes, backspace);
+    __m128i space =
+        _mm_cmpeq_epi8(_mm_min_epu8(shifted, space_range), shifted);
+    __m128i allowed =
+        _mm_or_si128(_mm_or_si128(space, _mm_cmpeq_epi8(bytes, escape)), nul);
+    __m128i control = _mm_or_si128(_mm_andnot_si128(allowed, low),
+                                   _mm_cmpeq_epi8(bytes, del));
+    masks.nul |= static_cast<uint64_t>(static_cast<uint16_t>(
+                     _mm_movemask_epi8(nul))) << i;
+    masks.control |= static_cast<uint64_t>(static_cast<uint16_t>(
+                         _mm_movemask_epi8(control))) << i;
+  }
+  return masks;
+}
+
+__attribute__((target("avx2"))) static ChunkMasks classify_avx2(
+    const char* text) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i last_low = _mm256_set1_epi8(0x1f);
+  const __m256i backspace = _mm256_set1_epi8('\b');
+  const __m256i space_range = _mm256_set1_epi8('\r' - '\b');
+  const __m256i escape = _mm256_set1_epi8(0x1b);
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  ChunkMasks masks{0, 0};
+  for (size_t i = 0; i < kChunkSize; i += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+    __m256i nul = _mm256_cmpeq_epi8(bytes, zero);
+    __m256i low =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_low), bytes);
+    __m256i shifted = _mm256_sub_epi8(bytes, backspace);
+    __m256i space =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, space_range), shifted);
+    __m256i allowed = _mm256_or_si256(
+        _mm256_or_si256(space, _mm256_cmpeq_epi8(bytes, escape)), nul);
+    __m256i control = _mm256_or_si256(_mm256_andnot_si256(allowed, low),
+                                      _mm256_cmpeq_epi8(bytes, del));
+    masks.nul |= static_cast<uint64_t>(static_cast<uint32_t>(
+                     _mm256_movemask_epi8(nul))) << i;
+    masks.control |= static_cast<uint64_t>(static_cast<uint32_t>(
+                         _mm256_movemask_epi8(control))) << i;
+  }
+  return masks;
+}
+
+typedef ChunkMasks (*classify_fn)(const char*);
+
+// Returns the widest kernel the CPU supports
+static classify_fn pick_kernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return classify_avx2;
+  }
+  return classify_sse2;
+}
+
+NameKind classify_name(std::string_view path) {
+  size_t slash = path.rfind('/');
+  std::string_view name =
+      slash == std::string_view::npos ? path : path.substr(slash + 1);
+  size_t dot = name.rfind('.');
+  if (dot == std::string_view::npos || dot == 0) {
+    return NameKind::kUnknown;
+  }
+
+  std::string extension(name.substr(dot + 1));
+  for (char& c : extension) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+  }
+  if (std::binary_search(std::begin(kBinaryExtensions),
+                         std::end(kBinaryExtensions), extension)) {
+    return NameKind::kBinary;
+  }
+  if (std::binary_search(std::begin(kTextExtensions),
+                         std::end(kTextExtensions), extension)) {
+    return NameKind::kText;
+  }
+  return NameKind::kUnknown;
+}
+
+bool looks_like_text(std::string_view head) {
+  static const classify_fn classify = pick_kernel();
+
+  const char* data = head.data();
+  size_t size = head.size();
+  size_t num_control = 0;
+  for (size_t base = 0; base < size; base += kChunkSize) {
+    ChunkMasks masks = size - base >= kChunkSize
+                           ? classify(data + base)
+                           : classify_scalar(data + base, size - base);
+    if (masks.nul != 0) {
+      return false;
+    }
+    num_control += __builtin_popcountll(masks.control);
+  }
+  return num_control * kControlRatio <= size;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,37 @@
+#ifndef TEXT_SNIFFER_HPP_
+#define TEXT_SNIFFER_HPP_
+
+#include <cstddef>
+#include <string_view>
+
+namespace searchserver {
+
+// The number of leading bytes of a file looked at to tell whether it is
+// text, which is all that is read of a file that turns out not to be
+constexpr size_t kSniffBytes = 4096;
+
+// What the name of a file says about its contents
+enum class NameKind {
+  kText,     // an extension of text files, e.g. ".txt" or ".cpp"
+  kBinary,   // an extension of binary files, e.g. ".png" or ".zip"
+  kUnknown,  // anything else, including no extension
+};
+
+// Classifies a file by the extension of its name, ignoring case.  A file
+// of kBinary kind is never indexed, and one of kText kind is indexed
+// without looking at its contents
+NameKind classify_name(std::string_view path);
+
+// Returns true if "head", the first bytes of a file, look like text: it
+// has no NUL byte, and at most one byte in 32 is a control character
+// other than the whitespace ones ('\b' to '\r') and escape, which
+// terminal logs are full of.
+//
+// Like tokenize(), the bytes are classified 64 at a time by the widest
+// kernel the CPU supports, AVX2 or SSE2, each producing bit masks of the
+// NUL and control bytes.
+bool looks_like_text(std::string_view head);
+
+}  // namespace searchserver
+
+#endif  // TEXT_SNIFFER_HPP_
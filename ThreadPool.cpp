@@ -9,7 +9,6 @@
  * author.
  */
 
-#include <unistd.h>
 #include <iostream>
 
 #include "./ThreadPool.hpp"
@@ -26,6 +25,7 @@ ThreadPool::ThreadPool(uint32_t num_threads) {
   killthreads_ = false;
   pthread_mutex_init(&q_lock_, nullptr);
   pthread_cond_init(&q_cond_, nullptr);
+  pthread_cond_init(&born_cond_, nullptr);
 
   // Allocate the array of pthread structures.
   thread_array_ = new pthread_t[num_threads];
@@ -40,11 +40,11 @@ ThreadPool::ThreadPool(uint32_t num_threads) {
                              static_cast<void *>(this));
   }
 
-  // Wait for all of the threads to be born and initialized.
+  // Wait for all of the threads to be born and initialized.  A thread
+  // only releases the lock by waiting on q_cond_, so once the count is
+  // complete every thread is waiting for work.
   while (num_threads_running_ != num_threads) {
-    pthread_mutex_unlock(&q_lock_);
-    sleep(1);  // give another thread the chance to acquire the lock
-    pthread_mutex_lock(&q_lock_);
+    pthread_cond_wait(&born_cond_, &q_lock_);
   }
   pthread_mutex_unlock(&q_lock_);
 
@@ -78,6 +78,7 @@ ThreadPool:: ~ThreadPool() {
   }
   thread_array_ = nullptr;
   pthread_mutex_unlock(&q_lock_);
+  pthread_cond_destroy(&born_cond_);
 
   // Empty the task queue, serially issuing any remaining work.
   while (!work_queue_.empty()) {
@@ -106,6 +107,7 @@ void *thread_loop(void *t_pool) {
   // constructor knows this new thread is alive.
   pthread_mutex_lock(&(pool->q_lock_));
   pool->num_threads_running_++;
+  pthread_cond_signal(&(pool->born_cond_));
 
   // This is our main thread work loop.
   while (pool->killthreads_ == false) {
@@ -80,6 +80,11 @@ class ThreadPool {
   // kill themselves, they decrement it.
   uint32_t num_threads_running_;
 
+  // Signaled by each worker thread once it has incremented
+  // num_threads_running_, so that the constructor can wait for all of
+  // them to be born without polling.
+  pthread_cond_t born_cond_;
+
  private:
   // The pthreads pthread_t structures representing each thread.
   pthread_t *thread_array_;
@@ -0,0 +1,119 @@
+#include "./Tokenizer.hpp"
+
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace searchserver {
+
+// The number of bytes classified at once, one per bit of the mask
+static constexpr size_t kChunkSize = 64;
+
+// A byte is a letter if setting its 0x20 bit, which is what tells upper
+// from lower case, gives one of 'a' to 'z'.  Bytes of 0x80 and up compare
+// as negative, so they are never letters.
+static uint64_t classify_scalar(char* text, size_t size) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < size; i++) {
+    char lower = static_cast<char>(text[i] | 0x20);
+    if (lower >= 'a' && lower <= 'z') {
+      text[i] = lower;
+      mask |= uint64_t{1} << i;
+    }
+  }
+  return mask;
+}
+
+static uint64_t classify_sse2(char* text) {
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  const __m128i before_a = _mm_set1_epi8('a' - 1);
+  const __m128i after_z = _mm_set1_epi8('z' + 1);
+  uint64_t mask = 0;
+  for (size_t i = 0; i < kChunkSize; i += 16) {
+    __m128i* p = reinterpret_cast<__m128i*>(text + i);
+    __m128i bytes = _mm_loadu_si128(p);
+    __m128i lower = _mm_or_si128(bytes, case_bit);
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lower, before_a),
+                                    _mm_cmplt_epi8(lower, after_z));
+    _mm_storeu_si128(
+        p, _mm_or_si128(bytes, _mm_and_si128(letters, case_bit)));
+    mask |= static_cast<uint64_t>(static_cast<uint16_t>(
+                _mm_movemask_epi8(letters))) << i;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) static uint64_t classify_avx2(char* text) {
+  const __m256i case_bit = _mm256_set1_epi8(0x20);
+  const __m256i before_a = _mm256_set1_epi8('a' - 1);
+  const __m256i after_z = _mm256_set1_epi8('z' + 1);
+  uint64_t mask = 0;
+  for (size_t i = 0; i < kChunkSize; i += 32) {
+    __m256i* p = reinterpret_cast<__m256i*>(text + i);
+    __m256i bytes = _mm256_loadu_si256(p);
+    __m256i lower = _mm256_or_si256(bytes, case_bit);
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(lower, before_a),
+                                       _mm256_cmpgt_epi8(after_z, lower));
+    _mm256_storeu_si256(
+        p, _mm256_or_si256(bytes, _mm256_and_si256(letters, case_bit)));
+    mask |= static_cast<uint64_t>(static_cast<uint32_t>(
+                _mm256_movemask_epi8(letters))) << i;
+  }
+  return mask;
+}
+
+typedef uint64_t (*classify_fn)(char*);
+
+// Returns the widest kernel the CPU supports
+static classify_fn pick_kernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return classify_avx2;
+  }
+  return classify_sse2;
+}
+
+void tokenize(string* text, vector<std::string_view>* words) {
+  static const classify_fn classify = pick_kernel();
+
+  char* data = text->data();
+  size_t size = text->size();
+  size_t start = 0;       // where the current word starts
+  bool in_word = false;   // whether a word runs into the next chunk
+  for (size_t base = 0; base < size; base += kChunkSize) {
+    uint64_t letters = size - base >= kChunkSize
+                           ? classify(data + base)
+                           : classify_scalar(data + base, size - base);
+
+    // Alternate between finding the next letter, which starts a word,
+    // and the next non-letter, which ends it.  Past the end of the text
+    // the mask has no letters, which ends the last word.
+    size_t bit = 0;
+    while (true) {
+      uint64_t from = ~uint64_t{0} << bit;
+      if (in_word) {
+        uint64_t others = ~letters & from;
+        if (others == 0) {
+          break;
+        }
+        bit = __builtin_ctzll(others);
+        words->emplace_back(data + start, base + bit - start);
+        in_word = false;
+      } else {
+        uint64_t next = letters & from;
+        if (next == 0) {
+          break;
+        }
+        bit = __builtin_ctzll(next);
+        start = base + bit;
+        in_word = true;
+      }
+    }
+  }
+  if (in_word) {
+    words->emplace_back(data + start, size - start);
+  }
+}
+
+}  // namespace searchserver
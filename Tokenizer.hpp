@@ -0,0 +1,28 @@
+#ifndef TOKENIZER_HPP_
+#define TOKENIZER_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// Splits the contents of a document into the words that are indexed: the
+// runs of ASCII letters, with every other byte separating words.  The
+// letters of "text" are lower-cased in place and the words are appended
+// to "words" as views into "text", so no word is copied; they stay valid
+// for as long as "text" is neither changed nor destroyed.
+//
+// The bytes are classified and lower-cased 64 at a time by the widest
+// kernel the CPU supports, picked once at runtime: AVX2 with two 32-byte
+// registers or SSE2 with four 16-byte ones.  Either produces a bit mask
+// of the letters, and the words are found from where its runs of ones
+// start and end rather than by looking at the bytes one at a time.
+void tokenize(string* text, vector<std::string_view>* words);
+
+}  // namespace searchserver
+
+#endif  // TOKENIZER_HPP_
@@ -0,0 +1,307 @@
+#include "./TreeWatcher.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "./CrawlFileTree.hpp"
+
+namespace searchserver {
+
+// The events that can change what is indexed under a directory
+static constexpr uint32_t kWatchMask =
+    IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR |
+    IN_EXCL_UNLINK;
+
+// Returns the current time of the monotonic clock in milliseconds
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Returns the path of "name" in directory "dir", joined the same way the
+// crawl joins them so that it matches the document names
+static string join(const string& dir, const char* name) {
+  string path = dir;
+  if (path.back() != '/') {
+    path += '/';
+  }
+  path += name;
+  return path;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// TreeWatcher
+///////////////////////////////////////////////////////////////////////////////
+TreeWatcher::TreeWatcher(const string& root_dir, WordIndex* index)
+    : root_dir_(root_dir),
+      index_(index),
+      inotify_fd_(-1),
+      stop_pipe_{-1, -1},
+      running_(false),
+      num_changed_(0) { }
+
+TreeWatcher::~TreeWatcher() {
+  stop();
+}
+
+bool TreeWatcher::start(string* error) {
+  if (running_) {
+    return true;
+  }
+
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ == -1) {
+    *error = string("inotify_init1: ") + strerror(errno);
+    return false;
+  }
+  if (pipe2(stop_pipe_, O_NONBLOCK | O_CLOEXEC) == -1) {
+    *error = string("pipe2: ") + strerror(errno);
+    stop();
+    return false;
+  }
+  if (!add_watches(root_dir_, error)) {
+    stop();
+    return false;
+  }
+
+  if (pthread_create(&thread_, nullptr, watch_thread, this) != 0) {
+    *error = "can't create the watcher thread";
+    stop();
+    return false;
+  }
+  running_ = true;
+  return true;
+}
+
+void TreeWatcher::stop() {
+  if (running_) {
+    char byte = 0;
+    while (write(stop_pipe_[1], &byte, 1) == -1 && errno == EINTR) { }
+    pthread_join(thread_, nullptr);
+    running_ = false;
+  }
+
+  // Closing the inotify instance drops all of its watches
+  for (int* fd : {&inotify_fd_, &stop_pipe_[0], &stop_pipe_[1]}) {
+    if (*fd != -1) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+  dirs_.clear();
+}
+
+size_t TreeWatcher::num_changed() const {
+  return num_changed_.load(std::memory_order_relaxed);
+}
+
+void* TreeWatcher::watch_thread(void* arg) {
+  static_cast<TreeWatcher*>(arg)->run();
+  return nullptr;
+}
+
+void TreeWatcher::run() {
+  // Anything that changed before the watches were set up was missed, so
+  // the first batch looks at the whole tree
+  set<string> batch;
+  batch.insert(root_dir_);
+  int64_t first_event = now_ms();
+  int64_t last_event = first_event;
+
+  while (true) {
+    int timeout = -1;
+    if (!batch.empty()) {
+      int64_t due = std::min(last_event + kDebounceMs,
+                             first_event + kMaxDelayMs);
+      timeout = static_cast<int>(std::max<int64_t>(due - now_ms(), 0));
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = inotify_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_pipe_[0];
+    fds[1].events = POLLIN;
+    int ready = poll(fds, 2, timeout);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    if (fds[1].revents != 0) {
+      return;
+    }
+
+    if (ready == 0) {
+      apply(&batch);
+      continue;
+    }
+    if (fds[0].revents != 0) {
+      bool was_empty = batch.empty();
+      read_events(&batch);
+      if (!batch.empty()) {
+        last_event = now_ms();
+        if (was_empty) {
+          first_event = last_event;
+        }
+      }
+    }
+  }
+}
+
+bool TreeWatcher::add_watches(const string& path, string* error) {
+  int wd = inotify_add_watch(inotify_fd_, path.c_str(), kWatchMask);
+  if (wd == -1) {
+    // The directory may already be gone again, which its parent's events
+    // take care of
+    if (errno == ENOENT || errno == ENOTDIR) {
+      return true;
+    }
+    *error = "can't watch " + path + ": " + strerror(errno);
+    return false;
+  }
+  vector<string>& paths = dirs_[wd];
+  if (std::find(paths.begin(), paths.end(), path) != paths.end()) {
+    return true;
+  }
+  paths.push_back(path);
+
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return true;
+  }
+  vector<string> subdirs;
+  struct dirent* dirent;
+  while ((dirent = readdir(dir)) != nullptr) {
+    if (strcmp(dirent->d_name, ".") == 0 ||
+        strcmp(dirent->d_name, "..") == 0) {
+      continue;
+    }
+    // Follow symbolic links to directories like the crawl does
+    string subdir = join(path, dirent->d_name);
+    struct stat sit;
+    if (dirent->d_type == DT_DIR ||
+        ((dirent->d_type == DT_LNK || dirent->d_type == DT_UNKNOWN) &&
+         stat(subdir.c_str(), &sit) == 0 && S_ISDIR(sit.st_mode))) {
+      subdirs.push_back(std::move(subdir));
+    }
+  }
+  closedir(dir);
+
+  for (const string& subdir : subdirs) {
+    if (!add_watches(subdir, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TreeWatcher::remove_watches(const string& path, set<string>* batch) {
+  for (auto it = dirs_.begin(); it != dirs_.end();) {
+    vector<string>& paths = it->second;
+    auto removed = std::remove_if(paths.begin(), paths.end(),
+                                  [&](const string& dir) {
+                                    return is_under(dir, path);
+                                  });
+    if (removed != paths.end()) {
+      batch->insert(paths.begin(), removed);
+      paths.erase(removed, paths.end());
+    }
+    if (paths.empty()) {
+      inotify_rm_watch(inotify_fd_, it->first);
+      it = dirs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void TreeWatcher::read_events(set<string>* batch) {
+  alignas(struct inotify_event) char buf[16 * 1024];
+  while (true) {
+    ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+    if (len == -1 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      return;
+    }
+
+    for (char* p = buf; p < buf + len;) {
+      const struct inotify_event* event =
+          reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      // Events were lost; the whole tree has to be watched and looked at
+      // again
+      if (event->mask & IN_Q_OVERFLOW) {
+        batch->insert(root_dir_);
+        remove_watches(root_dir_, batch);
+        string error;
+        add_watches(root_dir_, &error);
+        continue;
+      }
+
+      auto it = dirs_.find(event->wd);
+      if (it == dirs_.end()) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        dirs_.erase(it);
+        continue;
+      }
+      // Copy the paths, which watches added or removed below may change
+      vector<string> dirs = it->second;
+      for (const string& dir : dirs) {
+        string path = event->len > 0 ? join(dir, event->name) : dir;
+
+        // A directory moved away keeps its watches, under a path that is
+        // no longer its own; one moved in or created gets watched, and
+        // crawled since files may have been put in it before it was
+        if (event->mask & IN_ISDIR) {
+          if (event->mask & IN_MOVED_FROM) {
+            remove_watches(path, batch);
+          } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            string error;
+            add_watches(path, &error);
+          }
+        }
+        batch->insert(std::move(path));
+      }
+    }
+  }
+}
+
+void TreeWatcher::apply(set<string>* batch) {
+  // A path under another one in the batch is covered by it
+  vector<string> paths;
+  for (const string& path : *batch) {
+    if (paths.empty() || !is_under(path, paths.back())) {
+      paths.push_back(path);
+    }
+  }
+  batch->clear();
+
+  num_changed_.fetch_add(update_paths(paths, index_),
+                         std::memory_order_relaxed);
+
+  // Rebuild the index once enough of it is stale, so that every change
+  // costs a bounded share of a rebuild
+  size_t num_stale = index_->num_stale_docs();
+  if (num_stale > 0 && num_stale * kRebuildRatio >= index_->num_docs()) {
+    index_->rebuild();
+  }
+}
+
+}  // namespace searchserver
@@ -0,0 +1,131 @@
+#ifndef TREE_WATCHER_HPP_
+#define TREE_WATCHER_HPP_
+
+extern "C" {
+  #include <pthread.h>  // for the watcher thread
+}
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./WordIndex.hpp"
+
+using std::set;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace searchserver {
+
+// A TreeWatcher keeps a live WordIndex in step with the directory tree it
+// was crawled from while the server goes on serving it.  It watches every
+// directory of the tree with inotify, on a thread of its own, and collects
+// the paths that events name: files written, created, deleted or moved,
+// and directories created, deleted or moved, which get watched in turn.
+//
+// Events come in bursts (an editor saving a file, a checkout touching
+// hundreds), so the paths are batched: a batch is applied once no event
+// has arrived for kDebounceMs, or kMaxDelayMs after its first event if
+// they keep coming.  Applying a batch runs update_paths(), which only
+// indexes the files whose stamp changed and removes the documents of
+// files that are gone, without compacting the index.
+//
+// Every change leaves a stale document behind: the old version of a file
+// is only hidden, and the new one is scored with the statistics of the
+// index as it was crawled.  Once stale documents make up 1/kRebuildRatio
+// of the doc table, the index is rebuilt (see WordIndex::rebuild()),
+// which drops the hidden ones and scores the rest afresh, while lookups
+// go on.  Until then, a few edits in a large tree leave the ranking of the
+// edited files slightly off.
+//
+// Symbolic links to directories are followed like the crawl follows them,
+// and a directory reached by several paths is looked at under all of
+// them.  inotify can't say when a link that dangles starts to point to a
+// directory again, though, so the files under it are only found by the
+// next crawl.
+class TreeWatcher {
+ public:
+  // How long the tree must be quiet before a batch is applied
+  static constexpr int kDebounceMs = 200;
+
+  // The longest a batch waits after its first event
+  static constexpr int kMaxDelayMs = 2000;
+
+  // The index is rebuilt once one document in this many is stale
+  static constexpr size_t kRebuildRatio = 8;
+
+  // Constructs a watcher for the tree at "root_dir", which must be the
+  // directory "index" was crawled from, named the same way
+  TreeWatcher(const string& root_dir, WordIndex* index);
+
+  // Stops the watcher if it is running
+  ~TreeWatcher();
+
+  // Watches every directory of the tree and starts the watcher thread.
+  // Since the tree may have changed between the crawl and the watches
+  // being set up, the first batch checks the stamps of the whole tree.
+  // Returns false and a message through "error" if a directory can't be
+  // watched, e.g. because there are more than fs.inotify.max_user_watches
+  bool start(string* error);
+
+  // Stops the watcher thread, dropping the batch it is collecting
+  void stop();
+
+  // Returns the number of files the watcher has added to, updated in or
+  // removed from the index so far
+  size_t num_changed() const;
+
+  // delete cctor and op=
+  TreeWatcher(const TreeWatcher& other) = delete;
+  TreeWatcher& operator=(const TreeWatcher& other) = delete;
+
+ private:
+  // The body of the watcher thread.  "arg" is the TreeWatcher
+  static void* watch_thread(void* arg);
+
+  // Waits for events and applies batches until stop() is called
+  void run();
+
+  // Watches the directory at "path" and every directory under it.
+  // Returns false and a message through "error" on failure
+  bool add_watches(const string& path, string* error);
+
+  // Forgets the watches of the directory at "path" and every directory
+  // under it, whose paths have gone stale.  The other paths of those
+  // directories, through symbolic links that may now be dangling or
+  // point elsewhere, are added to "batch"
+  void remove_watches(const string& path, set<string>* batch);
+
+  // Reads the pending events, adding the paths they name to "batch"
+  void read_events(set<string>* batch);
+
+  // Indexes the paths of a batch again, and empties it
+  void apply(set<string>* batch);
+
+  string root_dir_;
+  WordIndex* index_;
+
+  // The inotify instance and the paths of the directory each of its
+  // watches is on; one reached through symbolic links has several, which
+  // share the watch.  Only used by the watcher thread once it has started
+  int inotify_fd_;
+  unordered_map<int, vector<string>> dirs_;
+
+  // stop() writes to the write end of this pipe to wake the thread
+  int stop_pipe_[2];
+
+  pthread_t thread_;
+  bool running_;
+
+  // Written by the watcher thread, read by num_changed()
+  std::atomic<size_t> num_changed_;
+};
+
+}  // namespace searchserver
+
+#endif  // TREE_WATCHER_HPP_
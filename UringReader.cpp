@@ -0,0 +1,360 @@
+#include "./UringReader.hpp"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "./FileReader.hpp"
+
+namespace searchserver {
+
+// The io_uring system calls, which glibc has no wrappers for
+static int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit,
+                          unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void* arg,
+                             unsigned num_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, ring_fd, opcode, arg, num_args));
+}
+
+// Returns true if the kernel supports every operation the reader uses
+static bool supports_ops(int ring_fd) {
+  constexpr unsigned kNumOps = 256;
+  size_t size = sizeof(struct io_uring_probe) +
+                kNumOps * sizeof(struct io_uring_probe_op);
+  std::unique_ptr<char[]> buf(new char[size]());
+  struct io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buf.get());
+  if (io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, kNumOps) < 0) {
+    return false;
+  }
+  for (unsigned op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ,
+                      IORING_OP_CLOSE}) {
+    if (op > probe->last_op ||
+        (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the field at "offset" bytes into a mapped ring
+template <typename T>
+static T* field(void* ring, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// UringReader
+///////////////////////////////////////////////////////////////////////////////
+UringReader::UringReader(head_filter_fn filter, size_t head_size)
+    : ring_fd_(-1),
+      sq_ptr_(MAP_FAILED),
+      sq_size_(0),
+      cq_ptr_(MAP_FAILED),
+      cq_size_(0),
+      sqes_(nullptr),
+      sqes_size_(0),
+      num_queued_(0),
+      num_in_flight_(0),
+      filter_(filter),
+      head_size_(head_size),
+      requests_(kMaxFiles),
+      num_pending_(0) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = io_uring_setup(kQueueDepth, &params);
+  if (ring_fd < 0) {
+    return;
+  }
+  ring_fd_ = ring_fd;
+  if (!supports_ops(ring_fd_)) {
+    release();
+    return;
+  }
+
+  // Map the submission and completion rings, which newer kernels put in
+  // one mapping, and the submission queue entries
+  sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+  }
+  sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ptr_ != MAP_FAILED && !single_mmap) {
+    cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  void* cq_ptr = single_mmap ? sq_ptr_ : cq_ptr_;
+  if (sq_ptr_ == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sqes_size_);
+    }
+    release();
+    return;
+  }
+  sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+  sq_tail_ = field<unsigned>(sq_ptr_, params.sq_off.tail);
+  sq_mask_ = field<unsigned>(sq_ptr_, params.sq_off.ring_mask);
+  sq_array_ = field<unsigned>(sq_ptr_, params.sq_off.array);
+  cq_head_ = field<unsigned>(cq_ptr, params.cq_off.head);
+  cq_tail_ = field<unsigned>(cq_ptr, params.cq_off.tail);
+  cq_mask_ = field<unsigned>(cq_ptr, params.cq_off.ring_mask);
+  cqes_ = field<struct io_uring_cqe>(cq_ptr, params.cq_off.cqes);
+  sq_entries_ = params.sq_entries;
+
+  for (uint32_t slot = kMaxFiles; slot > 0; slot--) {
+    free_slots_.push_back(slot - 1);
+  }
+}
+
+UringReader::~UringReader() {
+  release();
+}
+
+void UringReader::release() {
+  // Closing the ring cancels whatever is still in flight
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_ptr_ != MAP_FAILED) {
+    munmap(cq_ptr_, cq_size_);
+    cq_ptr_ = MAP_FAILED;
+  }
+  if (sq_ptr_ != MAP_FAILED) {
+    munmap(sq_ptr_, sq_size_);
+    sq_ptr_ = MAP_FAILED;
+  }
+  if (ring_fd_ != -1) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+bool UringReader::can_submit() const {
+  return ok() && !free_slots_.empty() && num_in_flight_ + 2 <= sq_entries_;
+}
+
+void UringReader::submit(const string& path, size_t tag, bool filter) {
+  uint32_t slot = free_slots_.back();
+  free_slots_.pop_back();
+  num_pending_++;
+
+  Request& request = requests_[slot];
+  request.path = path;
+  request.tag = tag;
+  request.fd = -1;
+  request.error = 0;
+  request.phase_ops = 2;
+  request.filter = filter && filter_ != nullptr;
+  request.rejected = false;
+  request.contents.clear();
+  request.offset = 0;
+
+  // Open the file and look up its size at the same time
+  struct io_uring_sqe* sqe = next_sqe(kOpen, slot);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uint64_t>(request.path.c_str());
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+  sqe = next_sqe(kStat, slot);
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uint64_t>(request.path.c_str());
+  sqe->len = STATX_SIZE;
+  sqe->off = reinterpret_cast<uint64_t>(&request.stx);
+  sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+}
+
+void UringReader::wait(vector<File>* files) {
+  size_t num_files = files->size();
+  while (num_pending_ != 0 && files->size() == num_files) {
+    if (!enter(1)) {
+      fail(files);
+      return;
+    }
+
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      struct io_uring_cqe cqe = cqes_[head & *cq_mask_];
+      num_in_flight_--;
+      complete(cqe, files);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  // Hand the closes just queued to the kernel without waiting for them
+  if (num_queued_ != 0 && !enter(0)) {
+    fail(files);
+  }
+}
+
+struct io_uring_sqe* UringReader::next_sqe(Op op, uint32_t slot) {
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & *sq_mask_;
+  struct io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = (static_cast<uint64_t>(slot) << kOpBits) | op;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  num_queued_++;
+  num_in_flight_++;
+  return sqe;
+}
+
+void UringReader::read_more(uint32_t slot, vector<File>* files) {
+  Request& request = requests_[slot];
+  if (request.offset == request.contents.size()) {
+    finish(slot, files);
+    return;
+  }
+  // Read no further than the head until it has been filtered
+  size_t end = request.contents.size();
+  if (request.filter) {
+    end = std::min(end, head_size_);
+  }
+  struct io_uring_sqe* sqe = next_sqe(kRead, slot);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = request.fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&request.contents[request.offset]);
+  sqe->len = static_cast<uint32_t>(
+      std::min<size_t>(end - request.offset, 1u << 30));
+  sqe->off = request.offset;
+}
+
+void UringReader::finish(uint32_t slot, vector<File>* files) {
+  Request& request = requests_[slot];
+  if (request.fd != -1) {
+    struct io_uring_sqe* sqe = next_sqe(kClose, 0);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = request.fd;
+  }
+  bool ok = request.error == 0;
+  bool keep = ok && !request.rejected;
+  files->push_back(File{request.tag, ok, request.rejected,
+                        keep ? std::move(request.contents) : string()});
+  free_slots_.push_back(slot);
+  num_pending_--;
+}
+
+void UringReader::complete(const struct io_uring_cqe& cqe,
+                           vector<File>* files) {
+  Op op = static_cast<Op>(cqe.user_data & ((1 << kOpBits) - 1));
+  uint32_t slot = static_cast<uint32_t>(cqe.user_data >> kOpBits);
+  if (op == kClose) {
+    return;
+  }
+
+  Request& request = requests_[slot];
+  if (op == kOpen || op == kStat) {
+    if (cqe.res < 0 && request.error == 0) {
+      request.error = cqe.res;
+    } else if (op == kOpen && cqe.res >= 0) {
+      request.fd = cqe.res;
+    }
+    if (--request.phase_ops != 0) {
+      return;
+    }
+    if (request.error != 0) {
+      finish(slot, files);
+      return;
+    }
+    request.contents.resize(request.stx.stx_size);
+    read_more(slot, files);
+    return;
+  }
+
+  // A read; one that comes up short just ends the file early if the file
+  // shrank, and is followed by another otherwise
+  if (cqe.res < 0) {
+    request.error = cqe.res;
+    finish(slot, files);
+  } else if (cqe.res == 0) {
+    request.contents.resize(request.offset);
+    if (request.filter && !filter_(request.contents)) {
+      request.rejected = true;
+    }
+    finish(slot, files);
+  } else {
+    request.offset += static_cast<size_t>(cqe.res);
+    if (request.filter &&
+        request.offset >= std::min(request.contents.size(), head_size_)) {
+      request.filter = false;
+      if (!filter_(std::string_view(request.contents.data(),
+                                    request.offset))) {
+        request.rejected = true;
+        finish(slot, files);
+        return;
+      }
+    }
+    read_more(slot, files);
+  }
+}
+
+bool UringReader::enter(unsigned min_complete) {
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (true) {
+    int submitted = io_uring_enter(ring_fd_, num_queued_, min_complete, flags);
+    if (submitted >= 0) {
+      num_queued_ -= static_cast<unsigned>(submitted);
+      return true;
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      return false;
+    }
+  }
+}
+
+void UringReader::fail(vector<File>* files) {
+  // Whatever the kernel still holds goes away with the ring, so nothing
+  // it might still write to can be freed before it is closed
+  release();
+  for (uint32_t slot = 0; slot < requests_.size(); slot++) {
+    if (std::find(free_slots_.begin(), free_slots_.end(), slot) !=
+        free_slots_.end()) {
+      continue;
+    }
+    Request& request = requests_[slot];
+    if (request.fd != -1) {
+      close(request.fd);
+    }
+    File file{request.tag, false, false, string()};
+    FileReader reader(request.path);
+    file.ok = reader.read_file(&file.contents);
+    if (file.ok && request.filter && !filter_(std::string_view(
+            file.contents).substr(0, head_size_))) {
+      file.rejected = true;
+      file.contents.clear();
+    }
+    files->push_back(std::move(file));
+  }
+  free_slots_.clear();
+  num_pending_ = 0;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,161 @@
+#ifndef URING_READER_HPP_
+#define URING_READER_HPP_
+
+#include <sys/stat.h>  // for struct statx
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace searchserver {
+
+// A UringReader reads many files at once through an io_uring, so that a
+// crawl of a cold or remote disk waits for all of them at once rather
+// than for one file after another.  Every file takes an openat and a
+// statx, submitted together, then as many reads as it takes, then a
+// close; the operations of all the files in flight go to the kernel in
+// one system call, which also collects the ones that have completed.
+//
+// The ring is driven with the raw system calls, so there is nothing to
+// link against.  It needs a kernel with the operations above (5.6 or
+// later) that allows io_uring; where it can't be set up, ok() returns
+// false and the caller reads the files some other way.  Not thread-safe;
+// each thread that reads files uses a UringReader of its own.
+//
+// A file can also be read in two steps, stopping after its first bytes
+// if a filter rejects them, so that e.g. a crawl only reads the start of
+// a file that turns out not to be text.
+class UringReader {
+ public:
+  // Returns true if the first bytes of a file are worth reading the rest
+  typedef bool (*head_filter_fn)(std::string_view head);
+
+  // The number of submission queue entries of the ring
+  static constexpr unsigned kQueueDepth = 64;
+
+  // The number of files in flight at once; each takes up to two entries
+  static constexpr size_t kMaxFiles = kQueueDepth / 2;
+
+  // A file that has been read
+  struct File {
+    size_t tag;       // as passed to submit()
+    bool ok;          // false if it couldn't be opened or read
+    bool rejected;    // true if the filter rejected its first bytes
+    string contents;  // empty unless "ok" and not "rejected"
+  };
+
+  // Sets up the ring, if the kernel allows it.  Files submitted to be
+  // filtered are first read up to "head_size" bytes, which are passed to
+  // "filter"
+  explicit UringReader(head_filter_fn filter = nullptr,
+                       size_t head_size = 0);
+  ~UringReader();
+
+  // Returns true if the ring was set up and files can be submitted
+  bool ok() const { return ring_fd_ != -1; }
+
+  // Returns true if there is room for another file
+  bool can_submit() const;
+
+  // Returns the number of files submitted that haven't been returned by
+  // wait() yet
+  size_t num_pending() const { return num_pending_; }
+
+  // Starts reading the file at "path", which is returned by wait() along
+  // with "tag", passing its first bytes to the filter first if "filter"
+  // is true.  There must be room for it (see can_submit())
+  void submit(const string& path, size_t tag, bool filter = false);
+
+  // Submits what was queued, then waits until at least one file has been
+  // read, if any are pending, and appends the files read to "files"
+  void wait(vector<File>* files);
+
+  // delete cctor and op=
+  UringReader(const UringReader& other) = delete;
+  UringReader& operator=(const UringReader& other) = delete;
+
+ private:
+  // What an operation is, kept in the low bits of its user_data
+  enum Op : uint64_t { kOpen, kStat, kRead, kClose };
+  static constexpr uint64_t kOpBits = 2;
+
+  // A file in flight.  The kernel reads "path" and writes "stx" and
+  // "contents" until its operations complete, so requests never move
+  struct Request {
+    string path;
+    size_t tag;
+    int fd;
+    int error;            // the first error, as a negative errno
+    int phase_ops;        // operations of the open/stat phase pending
+    bool filter;          // whether its head still has to be filtered
+    bool rejected;
+    struct statx stx;
+    string contents;
+    size_t offset;        // the number of bytes read so far
+  };
+
+  // Returns an entry to fill in for an operation of request "slot", or
+  // of no request for a close
+  struct io_uring_sqe* next_sqe(Op op, uint32_t slot);
+
+  // Queues the next read of a request, or finishes it if it is complete
+  void read_more(uint32_t slot, vector<File>* files);
+
+  // Queues the close of a request's file and returns it through "files"
+  void finish(uint32_t slot, vector<File>* files);
+
+  // Handles one completion
+  void complete(const struct io_uring_cqe& cqe, vector<File>* files);
+
+  // Submits the queued entries, waiting for "min_complete" completions.
+  // Returns false if the ring has failed
+  bool enter(unsigned min_complete);
+
+  // Gives up on the ring, reading the pending files with a FileReader
+  void fail(vector<File>* files);
+
+  // Unmaps and closes the ring, after which ok() returns false
+  void release();
+
+  int ring_fd_;
+
+  // The mapped rings and the fields of the kernel's that we use
+  void* sq_ptr_;
+  size_t sq_size_;
+  void* cq_ptr_;
+  size_t cq_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  struct io_uring_cqe* cqes_;
+  unsigned sq_entries_;
+
+  // The entries queued since the last enter(), and the operations
+  // submitted whose completions haven't been seen yet
+  unsigned num_queued_;
+  unsigned num_in_flight_;
+
+  head_filter_fn filter_;
+  size_t head_size_;
+
+  vector<Request> requests_;
+  vector<uint32_t> free_slots_;
+  size_t num_pending_;
+};
+
+}  // namespace searchserver
+
+#endif  // URING_READER_HPP_
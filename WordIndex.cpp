@@ -1,76 +1,1426 @@
 #include "./WordIndex.hpp"
 #include <algorithm>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <utility>
+
+#include "./Levenshtein.hpp"
 
 namespace searchserver {
 
-WordIndex::WordIndex() {
-  word_index_ = unordered_map<string, unordered_map<string, size_t>>();
+// The largest quantized impact score
+static constexpr float kMaxImpact = 255;
+
+// What rebuild() renumbers a removed document to
+static constexpr DocId kNoDoc = std::numeric_limits<DocId>::max();
+
+// The scoring parameters section of an index file
+struct IndexParams {
+  uint32_t num_docs;
+  uint32_t impact_scores;
+  float impact_scale;
+  uint32_t reserved;
+};
+
+// Holds a reader-writer lock for reading until destroyed
+class ReadGuard {
+ public:
+  explicit ReadGuard(pthread_rwlock_t* lock) : lock_(lock) {
+    pthread_rwlock_rdlock(lock_);
+  }
+  ~ReadGuard() { pthread_rwlock_unlock(lock_); }
+
+ private:
+  pthread_rwlock_t* lock_;
+};
+
+// Holds a reader-writer lock for writing until destroyed
+class WriteGuard {
+ public:
+  explicit WriteGuard(pthread_rwlock_t* lock) : lock_(lock) {
+    pthread_rwlock_wrlock(lock_);
+  }
+  ~WriteGuard() { pthread_rwlock_unlock(lock_); }
+
+ private:
+  pthread_rwlock_t* lock_;
+};
+
+// Holds any number of reader-writer locks for reading until destroyed.
+// The caller is responsible for taking them in a consistent order
+class ReadGuards {
+ public:
+  ReadGuards() = default;
+  ~ReadGuards() {
+    for (pthread_rwlock_t* lock : locks_) {
+      pthread_rwlock_unlock(lock);
+    }
+  }
+
+  void lock(pthread_rwlock_t* lock) {
+    pthread_rwlock_rdlock(lock);
+    locks_.push_back(lock);
+  }
+
+ private:
+  vector<pthread_rwlock_t*> locks_;
+};
+
+// Same as above, for writing
+class WriteGuards {
+ public:
+  WriteGuards() = default;
+  ~WriteGuards() {
+    for (pthread_rwlock_t* lock : locks_) {
+      pthread_rwlock_unlock(lock);
+    }
+  }
+
+  void lock(pthread_rwlock_t* lock) {
+    pthread_rwlock_wrlock(lock);
+    locks_.push_back(lock);
+  }
+
+ private:
+  vector<pthread_rwlock_t*> locks_;
+};
+
+WordIndex::WordIndex()
+    : pending_removals_(0), frozen_docs_(0), impact_scores_(false),
+      impact_scale_(0), positions_(true), generation_(0), numbering_(0) {
+  // Prefer writers, so that a steady stream of lookups cannot starve
+  // updates.  Lookups never take the same lock twice, so this is safe.
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&docs_lock_, &attr);
+  for (Shard& shard : shards_) {
+    pthread_rwlock_init(&shard.lock, &attr);
+  }
+  pthread_rwlockattr_destroy(&attr);
+}
+
+WordIndex::~WordIndex() {
+  for (Shard& shard : shards_) {
+    pthread_rwlock_destroy(&shard.lock);
+  }
+  pthread_rwlock_destroy(&docs_lock_);
 }
 
 size_t WordIndex::num_words() {
-  size_t num_words = 0;
-  for (auto word : word_index_) {
-    num_words++;
+  // rebuild() swaps the frozen layout under every shard lock
+  ReadGuards guards;
+  for (Shard& shard : shards_) {
+    guards.lock(&shard.lock);
+  }
+  size_t count = frozen_ == nullptr ? 0 : frozen_->num_words();
+  for (const Shard& shard : shards_) {
+    for (const auto& entry : shard.words) {
+      PostingListView postings;
+      float idf;
+      if (frozen_ == nullptr || !frozen_->find(entry.first, &postings, &idf)) {
+        count++;
+      }
+    }
   }
+  return count;
+}
+
+size_t WordIndex::num_docs() {
+  ReadGuard guard(&docs_lock_);
+  return doc_names_.size();
+}
 
-  return num_words;
+size_t WordIndex::num_stale_docs() {
+  ReadGuard guard(&docs_lock_);
+  return pending_removals_ + (doc_names_.size() - frozen_docs_);
+}
+
+DocId WordIndex::register_doc(const string& doc_name) {
+  WriteGuard guard(&docs_lock_);
+  auto it = doc_ids_.find(doc_name);
+  if (it != doc_ids_.end()) {
+    return it->second;
+  }
+
+  DocId doc_id = append_doc(doc_name, 0);
+  doc_ids_[doc_name] = doc_id;
+  return doc_id;
+}
+
+bool WordIndex::find_stamp(const string& doc_name, FileStamp* stamp) {
+  ReadGuard guard(&docs_lock_);
+  auto it = doc_ids_.find(doc_name);
+  if (it == doc_ids_.end()) {
+    return false;
+  }
+  *stamp = doc_stamps_[it->second];
+  return true;
+}
+
+void WordIndex::list_documents(vector<string>* names) {
+  ReadGuard guard(&docs_lock_);
+  for (const auto& entry : doc_ids_) {
+    names->push_back(entry.first);
+  }
+}
+
+string WordIndex::doc_name(DocId doc_id) {
+  ReadGuard guard(&docs_lock_);
+  return doc_id < doc_names_.size() ? doc_names_[doc_id] : string();
+}
+
+bool WordIndex::doc_names(const vector<Result>& results, uint64_t numbering,
+                          vector<string>* names) {
+  // rebuild() renumbers under the write lock
+  ReadGuard guard(&docs_lock_);
+  if (numbering_.load(std::memory_order_relaxed) != numbering) {
+    return false;
+  }
+  for (const Result& result : results) {
+    names->push_back(result.doc_id < doc_names_.size()
+                         ? doc_names_[result.doc_id]
+                         : string());
+  }
+  return true;
+}
+
+void WordIndex::set_doc_length(DocId doc_id, uint32_t length) {
+  WriteGuard guard(&docs_lock_);
+  doc_lengths_[doc_id] = length;
+  generation_++;
+}
+
+void WordIndex::set_impact_scores(bool enabled) {
+  impact_scores_ = enabled;
+}
+
+void WordIndex::set_positions(bool enabled) {
+  positions_ = enabled;
+}
+
+void WordIndex::record(const string& word, DocId doc_id) {
+  Shard& shard = shards_[shard_of(word)];
+  WriteGuard guard(&shard.lock);
+  shard.words[word].postings.add(doc_id, 1);
+  generation_++;
 }
 
 void WordIndex::record(const string& word, const string& doc_name) {
-  if (word_index_.find(word) == word_index_.end()) {
-    word_index_[word] = unordered_map<string, size_t>();
+  record(word, register_doc(doc_name));
+}
+
+bool WordIndex::add_document(const string& doc_name,
+                             const vector<string>& words) {
+  Document doc;
+  prepare_document(words, &doc);
+  return add_document(doc_name, doc);
+}
+
+void WordIndex::prepare_document(const vector<string>& words,
+                                 Document* doc) {
+  prepare_document(vector<std::string_view>(words.begin(), words.end()), doc);
+}
+
+void WordIndex::prepare_document(const vector<std::string_view>& words,
+                                 Document* doc) {
+  doc->length = static_cast<uint32_t>(words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    doc->positions[words[i]].push_back(static_cast<uint32_t>(i));
   }
-  if (word_index_[word].find(doc_name) == word_index_[word].end()) {
-    word_index_[word][doc_name] = 0;
+
+  uint32_t index = 0;
+  for (const auto& entry : doc->positions) {
+    doc->by_shard[shard_of(entry.first)].push_back(index++);
   }
+}
 
-  word_index_[word][doc_name]++;
+bool WordIndex::add_document(const string& doc_name, const Document& doc) {
+  DocId doc_id;
+  {
+    WriteGuard guard(&docs_lock_);
+    if (doc_ids_.find(doc_name) != doc_ids_.end()) {
+      return false;
+    }
+    doc_id = append_doc(doc_name, doc.length, doc.stamp);
+    doc_ids_[doc_name] = doc_id;
+  }
+
+  add_postings(doc_id, doc);
+  generation_++;
+  return true;
 }
 
-vector<Result> WordIndex::lookup_word(const string& word) {
-  vector<Result> result;
+bool WordIndex::remove_document(const string& doc_name) {
+  WriteGuard guard(&docs_lock_);
+  auto it = doc_ids_.find(doc_name);
+  if (it == doc_ids_.end()) {
+    return false;
+  }
+
+  removed_[it->second] = 1;
+  pending_removals_++;
+  doc_ids_.erase(it);
+  generation_++;
+  return true;
+}
+
+void WordIndex::update_document(const string& doc_name,
+                                const vector<string>& words) {
+  Document doc;
+  prepare_document(words, &doc);
+  update_document(doc_name, doc);
+}
+
+void WordIndex::update_document(const string& doc_name, const Document& doc) {
+  // Index the new version under its own DocId before switching the name
+  // over to it and hiding the old one
+  DocId doc_id;
+  {
+    WriteGuard guard(&docs_lock_);
+    doc_id = append_doc(doc_name, doc.length, doc.stamp);
+  }
+
+  add_postings(doc_id, doc);
+
+  WriteGuard guard(&docs_lock_);
+  auto it = doc_ids_.find(doc_name);
+  if (it != doc_ids_.end()) {
+    removed_[it->second] = 1;
+    pending_removals_++;
+  }
+  doc_ids_[doc_name] = doc_id;
+  generation_++;
+}
+
+// What the threads of WordIndex::merge() share.  Each one takes the next
+// shard not yet taken until there are none left
+struct MergeTask {
+  WordIndex* index;
+  const vector<std::unique_ptr<WordIndex>>* parts;
+  const vector<DocId>* offsets;
+  std::atomic<size_t> next_shard;
+};
+
+void* WordIndex::merge_thread(void* arg) {
+  MergeTask* task = static_cast<MergeTask*>(arg);
+  for (size_t s = task->next_shard++; s < kNumShards;
+       s = task->next_shard++) {
+    task->index->merge_shard(s, *task->parts, *task->offsets);
+  }
+  return nullptr;
+}
+
+void WordIndex::merge(vector<std::unique_ptr<WordIndex>> parts,
+                      size_t num_threads) {
+  // Bring every part back to just its shards, without the postings of its
+  // removed documents
+  for (auto& part : parts) {
+    part->thaw();
+  }
+
+  // Append the doc tables
+  vector<DocId> offsets;
+  {
+    WriteGuard guard(&docs_lock_);
+    for (auto& part : parts) {
+      offsets.push_back(static_cast<DocId>(doc_names_.size()));
+      // Replay the part's documents in order as if each were added with
+      // update_document(), so a document the part replaced or removed
+      // also replaces or removes one of the same name added before it
+      for (size_t i = 0; i < part->doc_names_.size(); i++) {
+        const string& name = part->doc_names_[i];
+        DocId doc_id =
+            append_doc(name, part->doc_lengths_[i], part->doc_stamps_[i]);
+        auto it = doc_ids_.find(name);
+        if (it != doc_ids_.end()) {
+          removed_[it->second] = 1;
+          pending_removals_++;
+          doc_ids_.erase(it);
+        }
+        // thaw() already dropped the postings of the part's removed
+        // documents, so they are not pending
+        if (part->removed_[i] != 0) {
+          removed_[doc_id] = 1;
+        } else {
+          doc_ids_[name] = doc_id;
+        }
+      }
+    }
+  }
+
+  // Then the words, one shard per thread at a time
+  MergeTask task{this, &parts, &offsets, {0}};
+  num_threads = std::clamp<size_t>(num_threads, 1, kNumShards);
+  vector<pthread_t> threads(num_threads - 1);
+  for (pthread_t& thread : threads) {
+    pthread_create(&thread, nullptr, &WordIndex::merge_thread, &task);
+  }
+  merge_thread(&task);
+  for (pthread_t thread : threads) {
+    pthread_join(thread, nullptr);
+  }
+  generation_++;
+}
+
+void WordIndex::merge_shard(size_t s,
+                            const vector<std::unique_ptr<WordIndex>>& parts,
+                            const vector<DocId>& offsets) {
+  Shard& shard = shards_[s];
+  WriteGuard guard(&shard.lock);
+  vector<Posting> postings;
+  vector<uint32_t> positions;
+  for (size_t p = 0; p < parts.size(); p++) {
+    for (const auto& entry : parts[p]->shards_[s].words) {
+      // Keep the positions only if this index records them
+      PostingListView view = entry.second.postings.view();
+      bool has_positions = positions_ && view.has_positions();
+      postings.clear();
+      positions.clear();
+      if (has_positions) {
+        view.decode(&postings, &positions);
+      } else {
+        view.decode(&postings);
+      }
+
+      // Every DocId of a later part is larger than any before it, so
+      // appending keeps the list sorted
+      PostingList& out = shard.words[entry.first].postings;
+      const uint32_t* position = positions.data();
+      for (const Posting& posting : postings) {
+        out.add(posting.doc_id + offsets[p], posting.count,
+                has_positions ? position : nullptr);
+        position += has_positions ? posting.count : 0;
+      }
+    }
+  }
+}
+
+void WordIndex::compact() {
+  bm25_.prepare(doc_lengths_);
+
+  float max_score = 0;
+  for (Shard& shard : shards_) {
+    WriteGuard guard(&shard.lock);
+    for (auto& entry : shard.words) {
+      WordInfo& info = entry.second;
+      info.postings.seal();
+      info.idf = bm25_.idf(info.postings.size());
+      max_score = std::max(max_score, BM25::max_score(info.idf));
+    }
+  }
+
+  // The frozen postings were quantized against impact_scale_, so it can't
+  // change until freeze() lays everything out again
+  if (!impact_scores_ || frozen_ != nullptr) {
+    generation_++;
+    return;
+  }
+
+  // Quantize linearly against the best score any posting can get, so one
+  // scale serves every word and impacts can be summed across words
+  impact_scale_ = max_score / kMaxImpact;
+  vector<Posting> postings;
+  for (Shard& shard : shards_) {
+    WriteGuard guard(&shard.lock);
+    for (auto& entry : shard.words) {
+      WordInfo& info = entry.second;
+      postings.clear();
+      info.postings.decode(&postings);
+
+      vector<uint8_t> impacts;
+      impacts.reserve(postings.size());
+      for (const Posting& posting : postings) {
+        float score = bm25_.score(info.idf, posting.count, posting.doc_id);
+        float impact = std::clamp(std::round(score / impact_scale_), 1.0f,
+                                  kMaxImpact);
+        impacts.push_back(static_cast<uint8_t>(impact));
+      }
+      info.postings.set_impacts(std::move(impacts));
+    }
+  }
+  generation_++;
+}
+
+void WordIndex::freeze() {
+  bool updated = pending_removals_ > 0;
+  for (const Shard& shard : shards_) {
+    updated = updated || !shard.words.empty();
+  }
+  if (frozen_ != nullptr && !updated) {
+    return;
+  }
+
+  thaw();
+  compact();
+
+  // Lay the words out in sorted order
+  vector<std::pair<std::string_view, const WordInfo*>> words;
+  for (const Shard& shard : shards_) {
+    for (const auto& entry : shard.words) {
+      words.emplace_back(entry.first, &entry.second);
+    }
+  }
+  std::sort(words.begin(), words.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  frozen_ = std::make_unique<FrozenIndex>();
+  for (const auto& word : words) {
+    frozen_->add_word(word.first, word.second->postings, word.second->idf);
+  }
+  frozen_->finish();
+  frozen_docs_ = static_cast<DocId>(doc_names_.size());
+
+  // Release the hash maps
+  for (Shard& shard : shards_) {
+    shard.words.clear();
+  }
+  generation_++;
+}
+
+bool WordIndex::save(const string& path) {
+  freeze();
+
+  IndexParams params;
+  params.num_docs = static_cast<uint32_t>(doc_names_.size());
+  params.impact_scores = impact_scores_;
+  params.impact_scale = impact_scale_;
+  params.reserved = 0;
+
+  string name_bytes;
+  vector<uint64_t> name_offsets;
+  for (const string& name : doc_names_) {
+    name_offsets.push_back(name_bytes.size());
+    name_bytes += name;
+  }
+  name_offsets.push_back(name_bytes.size());
+
+  IndexFileWriter writer;
+  writer.add_section(kSectionParams, &params, sizeof(params));
+  writer.add_section(kSectionDocNames, name_bytes.data(), name_bytes.size());
+  writer.add_section(kSectionDocNameOffsets, name_offsets.data(),
+                     name_offsets.size() * sizeof(uint64_t));
+  writer.add_section(kSectionDocLengths, doc_lengths_.data(),
+                     doc_lengths_.size() * sizeof(uint32_t));
+  writer.add_section(kSectionDocRemoved, removed_.data(), removed_.size());
+  writer.add_section(kSectionDocStamps, doc_stamps_.data(),
+                     doc_stamps_.size() * sizeof(FileStamp));
+  frozen_->save(&writer);
+  return writer.write(path);
+}
+
+void WordIndex::rebuild() {
+  auto fresh = std::make_unique<WordIndex>();
+  fresh->impact_scores_ = impact_scores_;
+  fresh->positions_ = positions_;
+
+  // Copy the doc table without the removed documents.  The others keep
+  // their order, so renumbering keeps every posting list sorted
+  vector<DocId> new_ids;
+  {
+    ReadGuard guard(&docs_lock_);
+    new_ids.assign(doc_names_.size(), kNoDoc);
+    for (size_t i = 0; i < doc_names_.size(); i++) {
+      if (removed_[i] == 0) {
+        new_ids[i] = fresh->append_doc(doc_names_[i], doc_lengths_[i],
+                                       doc_stamps_[i]);
+        fresh->doc_ids_[doc_names_[i]] = new_ids[i];
+      }
+    }
+  }
+
+  // Then the words: those of the frozen layout along with what was added
+  // to them since, then those added since that it doesn't have.  Every
+  // DocId in the frozen layout is smaller than any in the shards
+  {
+    ReadGuards guards;
+    for (Shard& shard : shards_) {
+      guards.lock(&shard.lock);
+    }
+    PostingListView base;
+    float idf;
+    if (frozen_ != nullptr) {
+      for (auto it = frozen_->words().at(0); !it.done(); it.next()) {
+        vector<PostingListView> postings{frozen_->postings(it.index())};
+        const WordInfo* info = shards_[shard_of(it.term())].words.find(
+            it.term());
+        if (info != nullptr) {
+          postings.push_back(info->postings.view());
+        }
+        fresh->add_renumbered(it.term(), postings, new_ids);
+      }
+    }
+    for (const Shard& shard : shards_) {
+      for (const auto& entry : shard.words) {
+        if (frozen_ == nullptr || !frozen_->find(entry.first, &base, &idf)) {
+          fresh->add_renumbered(entry.first, {entry.second.postings.view()},
+                                new_ids);
+        }
+      }
+    }
+  }
+  fresh->freeze();
+
+  // Swap it in, holding every lock so that no lookup is halfway through
+  {
+    WriteGuards guards;
+    for (Shard& shard : shards_) {
+      guards.lock(&shard.lock);
+    }
+    guards.lock(&docs_lock_);
+    for (size_t s = 0; s < kNumShards; s++) {
+      std::swap(shards_[s].words, fresh->shards_[s].words);
+    }
+    std::swap(doc_names_, fresh->doc_names_);
+    std::swap(doc_lengths_, fresh->doc_lengths_);
+    std::swap(doc_stamps_, fresh->doc_stamps_);
+    std::swap(removed_, fresh->removed_);
+    std::swap(doc_ids_, fresh->doc_ids_);
+    pending_removals_ = 0;
+    std::swap(file_, fresh->file_);
+    std::swap(frozen_, fresh->frozen_);
+    frozen_docs_ = fresh->frozen_docs_;
+    std::swap(bm25_, fresh->bm25_);
+    impact_scale_ = fresh->impact_scale_;
+    numbering_++;
+    generation_++;
+  }
+
+  // "fresh" now holds the old index, which is freed once the locks are
+  // released
+}
+
+bool WordIndex::open(const string& path, string* error) {
+  auto file = std::make_unique<IndexFileReader>();
+  if (!file->open(path, error)) {
+    return false;
+  }
+
+  const void* params_data;
+  const void* names_data;
+  const void* offsets_data;
+  const void* lengths_data;
+  const void* removed_data;
+  const void* stamps_data;
+  size_t num_params, num_name_bytes, num_offsets, num_lengths, num_removed,
+      num_stamps;
+  if (!file->section(kSectionParams, sizeof(IndexParams), &params_data,
+                     &num_params) ||
+      !file->section(kSectionDocNames, 0, &names_data, &num_name_bytes) ||
+      !file->section(kSectionDocNameOffsets, sizeof(uint64_t), &offsets_data,
+                     &num_offsets) ||
+      !file->section(kSectionDocLengths, sizeof(uint32_t), &lengths_data,
+                     &num_lengths) ||
+      !file->section(kSectionDocRemoved, 0, &removed_data, &num_removed) ||
+      !file->section(kSectionDocStamps, sizeof(FileStamp), &stamps_data,
+                     &num_stamps) ||
+      num_params != 1) {
+    *error = path + " is missing its doc table";
+    return false;
+  }
+  const IndexParams& params = *static_cast<const IndexParams*>(params_data);
+  const char* names = static_cast<const char*>(names_data);
+  const uint64_t* offsets = static_cast<const uint64_t*>(offsets_data);
+  const uint32_t* lengths = static_cast<const uint32_t*>(lengths_data);
+  const uint8_t* removed = static_cast<const uint8_t*>(removed_data);
+  const FileStamp* stamps = static_cast<const FileStamp*>(stamps_data);
+  if (num_offsets != params.num_docs + 1ull ||
+      num_lengths != params.num_docs || num_removed != params.num_docs ||
+      num_stamps != params.num_docs ||
+      offsets[0] != 0 || offsets[params.num_docs] != num_name_bytes) {
+    *error = path + " has a corrupt doc table";
+    return false;
+  }
+
+  vector<string> doc_names;
+  unordered_map<string, DocId> doc_ids;
+  doc_names.reserve(params.num_docs);
+  for (size_t i = 0; i < params.num_docs; i++) {
+    if (offsets[i + 1] < offsets[i]) {
+      *error = path + " has a corrupt doc table";
+      return false;
+    }
+    doc_names.emplace_back(names + offsets[i], offsets[i + 1] - offsets[i]);
+    if (removed[i] == 0) {
+      doc_ids[doc_names.back()] = static_cast<DocId>(i);
+    }
+  }
+
+  auto frozen = std::make_unique<FrozenIndex>();
+  if (!frozen->load(*file, params.num_docs, error)) {
+    *error = path + ": " + *error;
+    return false;
+  }
+
+  // Everything checks out; take the file over
+  doc_names_ = std::move(doc_names);
+  doc_lengths_.assign(lengths, lengths + params.num_docs);
+  doc_stamps_.assign(stamps, stamps + params.num_docs);
+  removed_.assign(removed, removed + params.num_docs);
+  doc_ids_ = std::move(doc_ids);
+  pending_removals_ = 0;
+  for (Shard& shard : shards_) {
+    shard.words.clear();
+  }
+  impact_scores_ = params.impact_scores != 0;
+  impact_scale_ = params.impact_scale;
+  bm25_.prepare(doc_lengths_);
+  frozen_ = std::move(frozen);
+  frozen_docs_ = params.num_docs;
+  file_ = std::move(file);
+  generation_++;
+  return true;
+}
+
+size_t WordIndex::shard_of(std::string_view word) {
+  return std::hash<std::string_view>()(word) % kNumShards;
+}
+
+DocId WordIndex::append_doc(const string& doc_name, uint32_t length,
+                            const FileStamp& stamp) {
+  DocId doc_id = static_cast<DocId>(doc_names_.size());
+  doc_names_.push_back(doc_name);
+  doc_lengths_.push_back(length);
+  doc_stamps_.push_back(stamp);
+  removed_.push_back(0);
+  return doc_id;
+}
+
+void WordIndex::add_postings(DocId doc_id, const Document& doc) {
+  // Add the words shard by shard so that each shard is locked once per
+  // document
+  for (size_t s = 0; s < kNumShards; s++) {
+    if (doc.by_shard[s].empty()) {
+      continue;
+    }
+    WriteGuard guard(&shards_[s].lock);
+    for (uint32_t index : doc.by_shard[s]) {
+      const auto& entry = doc.positions.begin()[index];
+      const vector<uint32_t>& positions = entry.second;
+      shards_[s].words[entry.first].postings.add(
+          doc_id, static_cast<uint32_t>(positions.size()),
+          positions_ ? positions.data() : nullptr);
+    }
+  }
+}
+
+void WordIndex::add_renumbered(std::string_view word,
+                               const vector<PostingListView>& postings,
+                               const vector<DocId>& new_ids) {
+  PostingList out;
+  vector<Posting> decoded;
+  vector<uint32_t> positions;
+  for (const PostingListView& view : postings) {
+    decoded.clear();
+    positions.clear();
+    if (view.has_positions()) {
+      view.decode(&decoded, &positions);
+    } else {
+      view.decode(&decoded);
+    }
+    const uint32_t* p = positions.data();
+    for (const Posting& posting : decoded) {
+      DocId doc_id = new_ids[posting.doc_id];
+      if (doc_id != kNoDoc) {
+        out.add(doc_id, posting.count, view.has_positions() ? p : nullptr);
+      }
+      p += view.has_positions() ? posting.count : 0;
+    }
+  }
+  if (!out.empty()) {
+    shards_[shard_of(word)].words[word].postings = std::move(out);
+  }
+}
+
+void WordIndex::thaw() {
+  if (frozen_ == nullptr && pending_removals_ == 0) {
+    return;
+  }
+
+  // Appends the postings of the documents that have not been removed
+  auto append_live = [this](const PostingListView& view, PostingList* out) {
+    vector<Posting> postings;
+    vector<uint32_t> positions;
+    if (view.has_positions()) {
+      view.decode(&postings, &positions);
+    } else {
+      view.decode(&postings);
+    }
+    const uint32_t* p = positions.data();
+    for (const Posting& posting : postings) {
+      if (!is_removed(posting.doc_id)) {
+        out->add(posting.doc_id, posting.count,
+                 view.has_positions() ? p : nullptr);
+      }
+      p += view.has_positions() ? posting.count : 0;
+    }
+  };
 
-  if (word_index_.find(word) != word_index_.end()) {
-    for (auto doc : word_index_[word]) {
-      result.push_back(Result(doc.first, doc.second));
+  // Every DocId in the frozen layout is smaller than any in the shards,
+  // so rebuilding each list frozen part first keeps it sorted
+  for (Shard& shard : shards_) {
+    for (auto& entry : shard.words) {
+      PostingList postings;
+      PostingListView base;
+      float idf;
+      if (frozen_ != nullptr && frozen_->find(entry.first, &base, &idf)) {
+        append_live(base, &postings);
+      }
+      append_live(entry.second.postings.view(), &postings);
+      entry.second.postings = std::move(postings);
     }
   }
+  if (frozen_ != nullptr) {
+    for (auto it = frozen_->words().at(0); !it.done(); it.next()) {
+      Shard& shard = shards_[shard_of(it.term())];
+      if (shard.words.find(it.term()) == nullptr) {
+        append_live(frozen_->postings(it.index()),
+                    &shard.words[it.term()].postings);
+      }
+    }
+  }
+
+  // Drop the words that only occured in removed documents
+  for (Shard& shard : shards_) {
+    TermMap<WordInfo> live;
+    for (auto& entry : shard.words) {
+      if (!entry.second.postings.empty()) {
+        live[entry.first] = std::move(entry.second);
+      }
+    }
+    shard.words = std::move(live);
+  }
+
+  frozen_.reset();
+  file_.reset();
+  frozen_docs_ = 0;
+  pending_removals_ = 0;
+}
+
+bool WordIndex::find_word(std::string_view word, WordRef* ref) {
+  ref->base = PostingListView();
+  ref->delta = PostingListView();
+  ref->idf = 0;
+  ref->boost = 1;
+
+  float base_idf = 0;
+  if (frozen_ != nullptr) {
+    frozen_->find(word, &ref->base, &base_idf);
+  }
+
+  const WordInfo* info = shards_[shard_of(word)].words.find(word);
+  if (info != nullptr) {
+    ref->delta = info->postings.view();
+  }
+  if (ref->size() == 0) {
+    return false;
+  }
+
+  // Words that gained documents since the index was frozen are scored by
+  // their combined document frequency
+  if (ref->delta.empty()) {
+    ref->idf = base_idf;
+  } else if (frozen_ != nullptr) {
+    ref->idf = bm25_.idf(ref->size());
+  } else {
+    ref->idf = info->idf;
+  }
+  return true;
+}
+
+vector<Result> WordIndex::lookup_word(const string& word) {
+  Query query;
+  query.words.push_back(word);
+  vector<Result> result = match_query(query);
 
   // Sort the results with the highest rank first
-  std::sort(result.begin(), result.end(),
-            [](const Result& a, const Result& b) { return a.rank > b.rank; });
+  std::sort(result.begin(), result.end());
 
   return result;
 }
 
-vector<Result> WordIndex::lookup_query(const vector<string>& query) {
+vector<Result> WordIndex::lookup_query(const vector<string>& words) {
+  Query query;
+  query.words = words;
+  vector<Result> results = match_query(query);
+
+  // Sort the results with the highest rank first
+  std::sort(results.begin(), results.end());
+
+  return results;
+}
+
+vector<Result> WordIndex::lookup_query(const vector<string>& words, size_t k,
+                                       size_t offset, size_t* num_results) {
+  Query query;
+  query.words = words;
+  return lookup_query(query, k, offset, num_results);
+}
+
+vector<Result> WordIndex::lookup_query(const Query& query, size_t k,
+                                       size_t offset, size_t* num_results) {
+  vector<Result> results = match_query(query);
+  if (num_results != nullptr) {
+    *num_results = results.size();
+  }
+  if (offset >= results.size()) {
+    return vector<Result>();
+  }
+
+  // Put just the best offset + k results in order and drop the rest
+  size_t end = std::min(results.size(), offset + std::min(k, results.size()));
+  std::partial_sort(results.begin(), results.begin() + end, results.end());
+  results.resize(end);
+  results.erase(results.begin(), results.begin() + offset);
+
+  return results;
+}
+
+// Returns true if, for some occurance p of the first word, the i'th word
+// occurs at p + i.  positions[i] holds the counts[i] positions of the
+// i'th word in increasing order
+static bool has_phrase(const vector<const uint32_t*>& positions,
+                       const vector<uint32_t>& counts) {
+  vector<uint32_t> next(positions.size(), 0);
+  for (uint32_t a = 0; a < counts[0]; a++) {
+    uint32_t start = positions[0][a];
+    size_t i = 1;
+    for (; i < positions.size(); i++) {
+      uint32_t want = start + static_cast<uint32_t>(i);
+      while (next[i] < counts[i] && positions[i][next[i]] < want) {
+        next[i]++;
+      }
+      if (next[i] == counts[i]) {
+        return false;
+      }
+      if (positions[i][next[i]] != want) {
+        break;
+      }
+    }
+    if (i == positions.size()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<Result> WordIndex::match_query(const Query& query) {
   vector<Result> results;
 
-  for (auto word : query) {
-    vector<Result> word_results = lookup_word(word);
+  // A result has to contain every word, whether on its own or in a phrase;
+  // look each distinct one up once, without copying any
+  vector<std::string_view> terms(query.words.begin(), query.words.end());
+  for (const vector<string>& phrase : query.phrases) {
+    terms.insert(terms.end(), phrase.begin(), phrase.end());
+  }
+  std::sort(terms.begin(), terms.end());
+  terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
 
-    if (results.size() == 0) {
-      results = word_results;
+  // Hold the shard of every word for reading until the results are
+  // scored, taking the locks in increasing shard order.  A prefix or a
+  // fuzzy term can match words in any shard.
+  vector<size_t> shards;
+  bool all_shards = !query.prefixes.empty() || !query.fuzzy.empty() ||
+                    !query.excluded.prefixes.empty() ||
+                    !query.excluded.fuzzy.empty();
+  for (std::string_view word : terms) {
+    shards.push_back(shard_of(word));
+  }
+  for (const Terms& group : query.any) {
+    for (const string& word : group.words) {
+      shards.push_back(shard_of(word));
+    }
+    all_shards |= !group.prefixes.empty() || !group.fuzzy.empty();
+  }
+  for (const string& word : query.excluded.words) {
+    shards.push_back(shard_of(word));
+  }
+  if (all_shards) {
+    for (size_t s = 0; s < kNumShards; s++) {
+      shards.push_back(s);
+    }
+  }
+  std::sort(shards.begin(), shards.end());
+  shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+  ReadGuards guards;
+  for (size_t s : shards) {
+    guards.lock(&shards_[s].lock);
+  }
+
+  QueryPlan plan;
+  if (!plan_query(query, terms, &plan)) {
+    return results;
+  }
+  const vector<WordRef>& words = plan.words;
+  const vector<vector<WordRef>>& groups = plan.groups;
+
+  // Start from the rarest word or group, then intersect on DocIds alone,
+  // shrinking the candidates in place.  The candidates below frozen_docs_
+  // can only be in the frozen part of a word's postings and the rest only
+  // in its shard's part.  A group is either merged into one list up front
+  // or, when there are few candidates left, probed word by word for each
+  // of them.
+  vector<DocId> doc_ids;
+  vector<vector<Result>> merged(groups.size());
+  vector<bool> probed(groups.size(), false);
+  for (size_t i = 0; i < plan.steps.size(); i++) {
+    const PlanStep& step = plan.steps[i];
+    if (i > 0 && doc_ids.empty()) {
+      return results;
+    }
+
+    if (!step.group) {
+      const WordRef& ref = words[step.index];
+      if (i == 0) {
+        ref.base.decode_doc_ids(&doc_ids);
+        ref.delta.decode_doc_ids(&doc_ids);
+        continue;
+      }
+      size_t split = std::lower_bound(doc_ids.begin(), doc_ids.end(),
+                                      frozen_docs_) - doc_ids.begin();
+      size_t n = ref.base.intersect(doc_ids.data(), split, doc_ids.data());
+      n += ref.delta.intersect(doc_ids.data() + split,
+                               doc_ids.size() - split, doc_ids.data() + n);
+      doc_ids.resize(n);
+    } else if (i > 0 && should_probe(doc_ids.size(),
+                                     groups[step.index].size(),
+                                     step.doc_freq)) {
+      probe_group(groups[step.index], &doc_ids);
+      probed[step.index] = true;
     } else {
-      vector<Result> new_results;
-      for (auto result : results) {
-        for (auto word_result : word_results) {
-          if (result.doc_name == word_result.doc_name) {
-            new_results.push_back(
-                Result(result.doc_name, result.rank + word_result.rank));
-          }
+      merged[step.index] = merge_postings(groups[step.index]);
+      if (i == 0) {
+        for (const Result& result : merged[step.index]) {
+          doc_ids.push_back(result.doc_id);
         }
+      } else {
+        intersect_results(merged[step.index], &doc_ids);
       }
-      results = new_results;
     }
   }
 
-  // Sort the results with the highest rank first
-  std::sort(results.begin(), results.end(),
-            [](const Result& a, const Result& b) { return a.rank > b.rank; });
+  // Hide the documents removed since the last freeze()
+  {
+    ReadGuard guard(&docs_lock_);
+    if (pending_removals_ > 0) {
+      doc_ids.erase(std::remove_if(doc_ids.begin(), doc_ids.end(),
+                                   [this](DocId doc_id) {
+                                     return is_removed(doc_id);
+                                   }),
+                    doc_ids.end());
+    }
+  }
+
+  // Drop the documents with an excluded word
+  vector<WordRef> excluded;
+  expand_terms(query.excluded, &excluded);
+  for (size_t i = 0; i < excluded.size() && !doc_ids.empty(); i++) {
+    exclude(excluded[i], &doc_ids);
+  }
+
+  // Check the phrases on the documents that have all of their words
+  vector<const WordRef*> by_term(terms.size());
+  for (const WordRef& ref : words) {
+    by_term[ref.term] = &ref;
+  }
+  for (const vector<string>& phrase : query.phrases) {
+    vector<const WordRef*> phrase_words;
+    for (const string& word : phrase) {
+      size_t term = std::lower_bound(terms.begin(), terms.end(), word) -
+                    terms.begin();
+      phrase_words.push_back(by_term[term]);
+    }
+    match_phrase(phrase_words, &doc_ids);
+  }
+
+  // Only the surviving documents need to be scored
+  results.reserve(doc_ids.size());
+  for (DocId doc_id : doc_ids) {
+    results.push_back(Result(doc_id, 0));
+  }
+  for (const WordRef& ref : words) {
+    add_scores(ref, &results);
+  }
+  for (size_t g = 0; g < groups.size(); g++) {
+    if (probed[g]) {
+      add_group_scores(groups[g], &results);
+    } else {
+      add_scores(merged[g], &results);
+    }
+  }
 
   return results;
 }
 
+bool WordIndex::plan_query(const Query& query,
+                           const vector<std::string_view>& terms,
+                           QueryPlan* plan) {
+  // Find the posting list of every word.  If any word is missing from the
+  // index then no document can contain the whole query.
+  plan->words.resize(terms.size());
+  for (size_t i = 0; i < terms.size(); i++) {
+    WordRef& ref = plan->words[i];
+    if (!find_word(terms[i], &ref)) {
+      return false;
+    }
+    ref.term = i;
+    plan->steps.push_back(PlanStep{ref.size(), false, i});
+  }
+
+  // Expand every prefix, fuzzy term and group of alternatives into the
+  // words it stands for, any of which a document may contain.  A group
+  // matching nothing matches no document either.
+  auto add_group = [plan](vector<WordRef>&& group) {
+    if (group.empty()) {
+      return false;
+    }
+    size_t doc_freq = 0;
+    for (const WordRef& ref : group) {
+      doc_freq += ref.size();
+    }
+    plan->steps.push_back(PlanStep{doc_freq, true, plan->groups.size()});
+    plan->groups.push_back(std::move(group));
+    return true;
+  };
+  for (const string& prefix : query.prefixes) {
+    vector<WordRef> group;
+    expand_prefix(prefix, &group);
+    if (!add_group(std::move(group))) {
+      return false;
+    }
+  }
+  for (const FuzzyTerm& fuzzy : query.fuzzy) {
+    vector<WordRef> group;
+    expand_fuzzy(fuzzy, &group);
+    if (!add_group(std::move(group))) {
+      return false;
+    }
+  }
+  for (const Terms& terms : query.any) {
+    vector<WordRef> group;
+    expand_terms(terms, &group);
+    if (!add_group(std::move(group))) {
+      return false;
+    }
+  }
+
+  // Rarest first, so the candidates start (and stay) as few as possible
+  std::stable_sort(plan->steps.begin(), plan->steps.end(),
+                   [](const PlanStep& a, const PlanStep& b) {
+                     return a.doc_freq < b.doc_freq;
+                   });
+  return !plan->steps.empty();
+}
+
+bool WordIndex::should_probe(size_t num_candidates, size_t num_words,
+                             size_t doc_freq) {
+  // Probing seeks every word once per candidate; merging reads every
+  // posting of every word once
+  return num_candidates * num_words * kProbeCost < doc_freq;
+}
+
+void WordIndex::probe_group(const vector<WordRef>& group,
+                            vector<DocId>* doc_ids) {
+  vector<bool> found(doc_ids->size(), false);
+  for (const WordRef& ref : group) {
+    PostingListView::Cursor base(ref.base);
+    PostingListView::Cursor delta(ref.delta);
+    for (size_t i = 0; i < doc_ids->size(); i++) {
+      DocId doc_id = (*doc_ids)[i];
+      PostingListView::Cursor* cursor =
+          doc_id < frozen_docs_ ? &base : &delta;
+      if (cursor->seek(doc_id) && cursor->doc_id() == doc_id) {
+        found[i] = true;
+      }
+    }
+  }
+
+  size_t k = 0;
+  for (size_t i = 0; i < doc_ids->size(); i++) {
+    if (found[i]) {
+      (*doc_ids)[k++] = (*doc_ids)[i];
+    }
+  }
+  doc_ids->resize(k);
+}
+
+void WordIndex::add_group_scores(const vector<WordRef>& group,
+                                 vector<Result>* results) {
+  for (const WordRef& ref : group) {
+    PostingListView::Cursor base(ref.base);
+    PostingListView::Cursor delta(ref.delta);
+    for (Result& result : *results) {
+      bool is_base = result.doc_id < frozen_docs_;
+      PostingListView::Cursor* cursor = is_base ? &base : &delta;
+      if (cursor->seek(result.doc_id) && cursor->doc_id() == result.doc_id) {
+        result.rank += ref.boost * score(is_base ? ref.base : ref.delta,
+                                         cursor, ref.idf, result.doc_id);
+      }
+    }
+  }
+}
+
+void WordIndex::expand_prefix(const string& prefix,
+                              vector<WordRef>* matches) {
+  // The frozen words starting with the prefix are a contiguous run of the
+  // sorted dictionary; the few words in the shards are checked one by one
+  vector<string> words;
+  if (frozen_ != nullptr) {
+    for (auto it = frozen_->words().lower_bound(prefix);
+         !it.done() && it.term().starts_with(prefix); it.next()) {
+      words.emplace_back(it.term());
+    }
+  }
+  for (const Shard& shard : shards_) {
+    for (const auto& entry : shard.words) {
+      if (entry.first.starts_with(prefix)) {
+        words.emplace_back(entry.first);
+      }
+    }
+  }
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+
+  vector<WordRef> refs;
+  for (const string& word : words) {
+    WordRef ref;
+    if (find_word(word, &ref)) {
+      refs.push_back(ref);
+    }
+  }
+  limit_expansions(&refs);
+  matches->insert(matches->end(), refs.begin(), refs.end());
+}
+
+void WordIndex::expand_fuzzy(const FuzzyTerm& fuzzy,
+                             vector<WordRef>* matches) {
+  // The frozen words are found by running the automaton along the sorted
+  // dictionary; the few words in the shards are checked one by one
+  LevenshteinAutomaton automaton(fuzzy.word, fuzzy.distance);
+  vector<LevenshteinAutomaton::Match> found;
+  if (frozen_ != nullptr) {
+    automaton.intersect(frozen_->words(), &found);
+  }
+  for (const Shard& shard : shards_) {
+    for (const auto& entry : shard.words) {
+      int distance;
+      if (automaton.matches(entry.first, &distance)) {
+        found.push_back(
+            LevenshteinAutomaton::Match{string(entry.first), distance});
+      }
+    }
+  }
+  std::sort(found.begin(), found.end(),
+            [](const LevenshteinAutomaton::Match& a,
+               const LevenshteinAutomaton::Match& b) {
+              return a.term < b.term;
+            });
+  found.erase(std::unique(found.begin(), found.end(),
+                          [](const LevenshteinAutomaton::Match& a,
+                             const LevenshteinAutomaton::Match& b) {
+                            return a.term == b.term;
+                          }),
+              found.end());
+
+  // Every edit away from the term the user typed halves a word's weight
+  vector<WordRef> refs;
+  for (const LevenshteinAutomaton::Match& match : found) {
+    WordRef ref;
+    if (find_word(match.term, &ref)) {
+      ref.boost = 1.0f / static_cast<float>(1 << match.distance);
+      refs.push_back(ref);
+    }
+  }
+  limit_expansions(&refs);
+  matches->insert(matches->end(), refs.begin(), refs.end());
+}
+
+void WordIndex::expand_terms(const Terms& terms, vector<WordRef>* matches) {
+  vector<std::string_view> words(terms.words.begin(), terms.words.end());
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+  for (std::string_view word : words) {
+    WordRef ref;
+    if (find_word(word, &ref)) {
+      matches->push_back(ref);
+    }
+  }
+  for (const string& prefix : terms.prefixes) {
+    expand_prefix(prefix, matches);
+  }
+  for (const FuzzyTerm& fuzzy : terms.fuzzy) {
+    expand_fuzzy(fuzzy, matches);
+  }
+}
+
+void WordIndex::exclude(const WordRef& ref, vector<DocId>* doc_ids) {
+  // Both cursors only ever move forward, skipping whole blocks of
+  // postings that lie between the candidates
+  PostingListView::Cursor base(ref.base);
+  PostingListView::Cursor delta(ref.delta);
+  size_t k = 0;
+  for (DocId doc_id : *doc_ids) {
+    PostingListView::Cursor* cursor = doc_id < frozen_docs_ ? &base : &delta;
+    if (!cursor->seek(doc_id) || cursor->doc_id() != doc_id) {
+      (*doc_ids)[k++] = doc_id;
+    }
+  }
+  doc_ids->resize(k);
+}
+
+void WordIndex::limit_expansions(vector<WordRef>* matches) {
+  // Keep only the closest, then most common, words if there are too many
+  if (matches->size() > kMaxExpansions) {
+    std::nth_element(matches->begin(), matches->begin() + kMaxExpansions,
+                     matches->end(), [](const WordRef& a, const WordRef& b) {
+                       if (a.boost != b.boost) {
+                         return a.boost > b.boost;
+                       }
+                       return a.size() > b.size();
+                     });
+    matches->resize(kMaxExpansions);
+  }
+}
+
+vector<Result> WordIndex::merge_postings(const vector<WordRef>& words) {
+  // A cursor for each part of each word's postings, and a min-heap of
+  // (DocId, cursor) pairs for those that are not done yet
+  struct Part {
+    const PostingListView* postings;
+    float idf;
+    float boost;
+  };
+  vector<Part> parts;
+  vector<PostingListView::Cursor> cursors;
+  for (const WordRef& ref : words) {
+    for (const PostingListView* postings : {&ref.base, &ref.delta}) {
+      if (!postings->empty()) {
+        parts.push_back(Part{postings, ref.idf, ref.boost});
+      }
+    }
+  }
+  cursors.reserve(parts.size());
+  using Entry = std::pair<DocId, size_t>;
+  std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> heap;
+  for (size_t i = 0; i < parts.size(); i++) {
+    cursors.emplace_back(*parts[i].postings);
+    heap.push(Entry(cursors[i].doc_id(), i));
+  }
+
+  // Pop the smallest DocId, adding up the scores of every word in it
+  vector<Result> merged;
+  while (!heap.empty()) {
+    auto [doc_id, i] = heap.top();
+    heap.pop();
+    if (merged.empty() || merged.back().doc_id != doc_id) {
+      merged.push_back(Result(doc_id, 0));
+    }
+    merged.back().rank +=
+        parts[i].boost *
+        score(*parts[i].postings, &cursors[i], parts[i].idf, doc_id);
+
+    cursors[i].next();
+    if (!cursors[i].done()) {
+      heap.push(Entry(cursors[i].doc_id(), i));
+    }
+  }
+  return merged;
+}
+
+void WordIndex::intersect_results(const vector<Result>& merged,
+                                  vector<DocId>* doc_ids) {
+  size_t k = 0;
+  size_t j = 0;
+  for (DocId doc_id : *doc_ids) {
+    while (j < merged.size() && merged[j].doc_id < doc_id) {
+      j++;
+    }
+    if (j == merged.size()) {
+      break;
+    }
+    if (merged[j].doc_id == doc_id) {
+      (*doc_ids)[k++] = doc_id;
+    }
+  }
+  doc_ids->resize(k);
+}
+
+void WordIndex::add_scores(const vector<Result>& merged,
+                           vector<Result>* results) {
+  size_t j = 0;
+  for (Result& result : *results) {
+    while (merged[j].doc_id < result.doc_id) {
+      j++;
+    }
+    result.rank += merged[j].rank;
+  }
+}
+
+void WordIndex::match_phrase(const vector<const WordRef*>& words,
+                             vector<DocId>* doc_ids) {
+  for (const WordRef* ref : words) {
+    if ((!ref->base.empty() && !ref->base.has_positions()) ||
+        (!ref->delta.empty() && !ref->delta.has_positions())) {
+      return;
+    }
+  }
+
+  // One cursor per word for each part of the postings; the candidates
+  // are in DocId order, so every cursor only ever moves forward
+  vector<PostingListView::Cursor> base;
+  vector<PostingListView::Cursor> delta;
+  base.reserve(words.size());
+  delta.reserve(words.size());
+  for (const WordRef* ref : words) {
+    base.emplace_back(ref->base);
+    delta.emplace_back(ref->delta);
+  }
+
+  vector<const uint32_t*> positions(words.size());
+  vector<uint32_t> counts(words.size());
+  size_t k = 0;
+  for (DocId doc_id : *doc_ids) {
+    vector<PostingListView::Cursor>& cursors =
+        doc_id < frozen_docs_ ? base : delta;
+    for (size_t i = 0; i < words.size(); i++) {
+      cursors[i].seek(doc_id);
+      counts[i] = cursors[i].count();
+      positions[i] = cursors[i].positions();
+    }
+    if (has_phrase(positions, counts)) {
+      (*doc_ids)[k++] = doc_id;
+    }
+  }
+  doc_ids->resize(k);
+}
+
+void WordIndex::add_scores(const WordRef& ref, vector<Result>* results) {
+  Result* begin = results->data();
+  Result* end = begin + results->size();
+  Result* split = std::lower_bound(begin, end, frozen_docs_,
+                                   [](const Result& result, DocId doc_id) {
+                                     return result.doc_id < doc_id;
+                                   });
+  add_scores(ref.base, ref.idf, begin, split);
+  add_scores(ref.delta, ref.idf, split, end);
+}
+
+void WordIndex::add_scores(const PostingListView& postings, float idf,
+                           Result* begin, Result* end) {
+  if (begin == end) {
+    return;
+  }
+
+  PostingListView::Cursor cursor(postings);
+  for (Result* result = begin; result != end; result++) {
+    cursor.seek(result->doc_id);
+    result->rank += score(postings, &cursor, idf, result->doc_id);
+  }
+}
+
 }  // namespace searchserver
@@ -1,14 +1,27 @@
 #ifndef WORD_INDEX_HPP_
 #define WORD_INDEX_HPP_
 
+extern "C" {
+  #include <pthread.h>  // for the pthread reader-writer locks
+}
+
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <list>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "./BM25.hpp"
+#include "./FrozenIndex.hpp"
+#include "./IndexFile.hpp"
+#include "./PostingList.hpp"
+#include "./Query.hpp"
 #include "./Result.hpp"
+#include "./TermMap.hpp"
 
 using std::string;
 using std::unordered_map;
@@ -17,41 +30,292 @@ using std::vector;
 namespace searchserver {
 
 // A WordIndex is used to keep track of which documents contain certain words
-// and how many occurances there are of that word in the document
+// and how many occurances there are of that word in the document.
+// Lookups rank documents with BM25 (see BM25.hpp)
+//
+// Documents can be added, removed and updated while lookups are running.
+// The words are split by hash into kNumShards shards, each with its own
+// reader-writer lock, so an update only ever blocks lookups that involve
+// a word in the same shard.  The doc table has a lock of its own.
+//
+// Once frozen (see freeze()), the bulk of the index lives in an immutable
+// FrozenIndex, which lookups read under the same shard read locks as the
+// rest, so that rebuild() can swap it; documents added afterwards go into
+// the shards on top of it, and removed documents are hidden from lookups
+// until the next freeze() drops their postings.
+// An index that is updated while it serves can be brought back to that
+// state without stopping lookups with rebuild().
 class WordIndex {
  public:
+  // The number of independently locked shards the words are split into
+  static constexpr size_t kNumShards = 16;
+
+  // The most words a prefix or fuzzy term is expanded into; past that,
+  // only the closest ones in the most documents are kept
+  static constexpr size_t kMaxExpansions = 256;
+
+  // Where a document's contents came from, for telling later whether they
+  // have changed: for a file, its inode, size and modification time.  The
+  // crawler keeps one for every file it indexes (see crawl_filetree()),
+  // and they are saved with the index.  All zero if unknown.
+  struct FileStamp {
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+
+    bool operator==(const FileStamp& other) const = default;
+  };
+
+  // The words of a document, grouped the way add_document() adds them:
+  // the positions of every distinct word, and which of those words go to
+  // each shard.  Building one is most of the work of adding a document but
+  // needs no lock, so a crawl can build them on other threads than the
+  // one adding them (see prepare_document())
+  struct Document {
+    // The number of words in the document
+    uint32_t length;
+
+    // Where the document came from; prepare_document() leaves it zero
+    FileStamp stamp;
+
+    // The positions of every distinct word
+    TermMap<vector<uint32_t>> positions;
+
+    // The indexes, in iteration order, of the entries of "positions" that
+    // belong to each shard
+    vector<uint32_t> by_shard[kNumShards];
+  };
+
   // Constructs an empty WordIndex that stores
   // no words or documents to start
   WordIndex();
+  ~WordIndex();
 
   // Returns the number of unique words recorded in the index
   size_t num_words();
 
-  // Record an occurance of a document having the specified word show up in it
+  // Returns the number of documents in the doc table, including removed
+  // documents whose DocIds have not been reused
+  size_t num_docs();
+
+  // Returns a number that changes every time the index changes in a way
+  // that can change the results of a lookup.  It only changes once the
+  // change is complete, so a result computed after reading generation g
+  // is still current for as long as generation() returns g.
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  // Returns a number that changes every time rebuild() gives the documents
+  // new DocIds.  The DocIds a lookup returns name the same documents for
+  // as long as numbering() returns what it did before the lookup ran.
+  uint64_t numbering() const {
+    return numbering_.load(std::memory_order_acquire);
+  }
+
+  // Returns the number of documents added or removed since the index was
+  // last frozen or rebuilt: the removed ones still have postings that
+  // lookups skip, and the added ones are scored with the statistics of
+  // the documents that were there then
+  size_t num_stale_docs();
+
+  // Adds a document and all of its words to the index under a new DocId.
+  // Safe to call concurrently with lookups and other updates.
+  //
+  // Arguments:
+  //  - doc_name: the name of the document
+  //  - words: every word in the document, in lower case, once per
+  //    occurance
+  //
+  // Returns: false if a document with this name is already in the index,
+  // true otherwise
+  bool add_document(const string& doc_name, const vector<string>& words);
+
+  // Groups the words of a document for add_document().  "words" are as
+  // for add_document(); "doc" must be empty
+  static void prepare_document(const vector<string>& words, Document* doc);
+  static void prepare_document(const vector<std::string_view>& words,
+                               Document* doc);
+
+  // Adds a document whose words were grouped by prepare_document().  Same
+  // as add_document() otherwise
+  bool add_document(const string& doc_name, const Document& doc);
+
+  // Removes a document from the index.  Lookups stop returning it right
+  // away; its postings are dropped by the next freeze().  Safe to call
+  // concurrently with lookups and other updates.
+  //
+  // Returns: false if there is no document with this name, true otherwise
+  bool remove_document(const string& doc_name);
+
+  // Replaces the contents of a document, adding it if it is not in the
+  // index yet.  The new contents get a new DocId; lookups may briefly
+  // see both versions, but never neither.  Safe to call concurrently with
+  // lookups and other updates.
+  void update_document(const string& doc_name, const vector<string>& words);
+
+  // Same as above, for a document whose words were grouped by
+  // prepare_document()
+  void update_document(const string& doc_name, const Document& doc);
+
+  // Looks up the stamp a document was added with.  Returns false if there
+  // is no document with this name
+  bool find_stamp(const string& doc_name, FileStamp* stamp);
+
+  // Appends the name of every document that has not been removed to
+  // "names", in no particular order
+  void list_documents(vector<string>* names);
+
+  // Looks up the DocId of the specified document, adding the document to
+  // the doc table under the next free DocId if it has not been seen before
+  //
+  // Arguments:
+  //  - doc_name: the name of the document
+  //
+  // Returns:
+  //  - the DocId the document is recorded under
+  DocId register_doc(const string& doc_name);
+
+  // Returns the name of the document with the specified DocId.
+  // The DocId must have been returned by register_doc(), or by a lookup
+  // if the index is never rebuilt (see doc_names()).  Returns an empty
+  // name for a DocId past the doc table
+  string doc_name(DocId doc_id);
+
+  // Looks up the names of the documents of "results", returned by a lookup
+  // that ran after numbering() returned "numbering", and appends them to
+  // "names" in the same order.  Returns false, leaving "names" alone, if
+  // rebuild() has renumbered the documents since, in which case the
+  // lookup has to be run again.  A DocId past the doc table, which only
+  // corrupt postings in an index file can produce, gets an empty name
+  bool doc_names(const vector<Result>& results, uint64_t numbering,
+                 vector<string>* names);
+
+  // Records the length of a document, in words, for length normalization.
+  // The DocId must have been returned by register_doc()
+  void set_doc_length(DocId doc_id, uint32_t length);
+
+  // Selects whether compact() also stores a quantized BM25 score with every
+  // posting.  Lookups then add up the stored one-byte scores instead of
+  // computing BM25 from the counts, at the cost of one byte per posting
+  // and some precision.  Off by default.
+  void set_impact_scores(bool enabled);
+
+  // Selects whether add_document() also records the position of every
+  // word in the document, which phrase queries need.  Positions roughly
+  // double the size of the postings.  On by default.
+  void set_positions(bool enabled);
+
+  // Returns whether add_document() records positions
+  bool positions() const { return positions_; }
+
+  // Record an occurance of a document having the specified word show up in it.
+  // The occurance has no position, so the word's postings stop keeping
+  // positions.  Must not be called once the index is frozen
   //
   // Arguments:
   //  - word: the word found in the specified document
-  //  - doc_name: the name of the document the word occurance showed up in
+  //  - doc_id: the DocId of the document the word occurance showed up in
   //
   // Returns: None
+  void record(const string& word, DocId doc_id);
+
+  // Same as above, but registers the document by name first.
+  // Prefer add_document() when recording a whole document, since this one
+  // has to look up the document name and lock a shard for every word.
   void record(const string& word, const string& doc_name);
 
+  // Moves every document of "parts" into this index, for building an
+  // index in parallel: each thread fills a private WordIndex with
+  // add_document(), without ever contending for a lock, and the parts are
+  // merged once all are done.
+  //
+  // The documents keep their order: those of parts[0] come first, in the
+  // order they were added to it, then those of parts[1] and so on, all
+  // after the documents already in this index.  Each is added as if by
+  // update_document(), replacing any document of the same name, and one a
+  // part removed also removes any of its name added before the part.  The
+  // words are merged shard by shard by up to "num_threads" threads; since
+  // a word is in the same shard of every index, no two threads ever touch
+  // the same posting list.  As after add_document(), call compact() or
+  // freeze() once done.  Nothing else may use the parts, which are
+  // destroyed.
+  void merge(vector<std::unique_ptr<WordIndex>> parts,
+             size_t num_threads = kNumShards);
+
+  // Compresses the partially filled last block of every posting list and
+  // precomputes everything scoring needs: the length norm of every
+  // document, the IDF of every word and, if enabled, the quantized scores.
+  // Call once all documents have been recorded and before looking anything
+  // up; recording afterwards still works but leaves the precomputed
+  // statistics stale until compact() is called again.  On a frozen index
+  // the words added since are not quantized, since the frozen postings'
+  // scores are against a scale that must not change; they are scored
+  // exactly until the next freeze().  Must not run concurrently with
+  // anything else.
+  void compact();
+
+  // Converts the index into its read-only FrozenIndex layout: compacts it,
+  // then moves every word, sorted, and its postings into a few flat
+  // arrays and empties the shards.  Lookups are served from the frozen
+  // layout from then on, still under the shard read locks, which they
+  // only wait for while an update holds one.  Calling it again folds the
+  // documents added and removed since into a new frozen layout; it does
+  // nothing if there were none.  Must not run concurrently with anything
+  // else.
+  void freeze();
+
+  // Freezes the index, then saves it along with its doc table and scoring
+  // parameters to an index file (see IndexFile.hpp) at "path".  Must not
+  // run concurrently with anything else.
+  //
+  // Returns: false if the file could not be written, true otherwise
+  bool save(const string& path);
+
+  // Rebuilds the index as freeze() would, for an index that keeps serving
+  // lookups while it is updated: the documents removed since it was last
+  // frozen are dropped for good, along with their postings and their
+  // entries in the doc table, the rest are given consecutive DocIds in
+  // the same order, and the statistics lookups score with are computed
+  // again over them.
+  //
+  // The new index is built off to the side, taking only read locks, and
+  // then swapped in under every lock, so lookups only wait for the swap;
+  // it takes as much memory again as the index while it runs.  Bumps
+  // numbering().  Safe to call concurrently with lookups, but not with
+  // updates or anything else.
+  void rebuild();
+
+  // Loads an index saved by save() into this (empty) index.  The file is
+  // mapped into memory and the postings are served straight out of it, so
+  // this only costs reading the doc table.  The index is frozen afterwards.
+  // Must not run concurrently with anything else.
+  //
+  // Arguments:
+  //  - path: the index file to open
+  //  - error: output parameter through which a description of the
+  //    problem is returned on failure
+  //
+  // Returns: false if the file could not be opened or is not a valid
+  // index file, true otherwise
+  bool open(const string& path, string* error);
+
   // Lookup a word in the index, getting a sorted list of all documents that
-  // contain the word and a rank which is the number of occurances of that word
-  // in the document
+  // contain the word and a rank which is the BM25 score of the document
+  // for that word
   //
   // Arguments:
   //  - word: a word we are looking up results for
   //
   // Returns:
-  //  - A list of results. Each result contains a document name and the number
-  //    of recorded occurances of the specified word in that document. The list
+  //  - A list of results. Each result contains a DocId and the BM25 score
+  //    of the specified word in that document. The list
   //    is sorted with documents with the highest rank at the front.
   vector<Result> lookup_word(const string& word);
 
   // Lookup a query (multiple words) in the index, getting a sorted list of all
   // documents that contain each word in the query and a rank which is the
-  // number of occurances of each word in the document.
+  // sum of the BM25 scores of each word in the document.
   //
   // Every Result in the returned vector contains every word in the input query
   // In other words, the returned vector is the intersection of looking up
@@ -61,20 +325,286 @@ class WordIndex {
   //  - word: a word we are looking up results for
   //
   // Returns:
-  //  - A list of results. Each result contains a document name and the sum of
+  //  - A list of results. Each result contains a DocId and the sum of
   //  the
-  //    number of recorded occurances of the each query word in that document.
+  //    BM25 scores of the each query word in that document.
   //    The list is sorted with documents with the highest rank at the front.
   vector<Result> lookup_query(const vector<string>& query);
 
+  // Same as above, but only returns one page of the sorted results: the
+  // (at most) k results starting at position "offset".  Only the top
+  // offset + k results are ever put in order, so this costs
+  // O(n log(offset + k)) for n matching documents instead of O(n log n).
+  //
+  // Arguments:
+  //  - query: the words we are looking up results for
+  //  - k: the maximum number of results to return
+  //  - offset: how many of the best results to skip
+  //  - num_results: output parameter through which the total number of
+  //    matching documents is returned.  May be nullptr
+  //
+  // Returns:
+  //  - The requested page of results, highest rank first
+  vector<Result> lookup_query(const vector<string>& query, size_t k,
+                              size_t offset, size_t* num_results = nullptr);
+
+  // Same as above, but for a parsed query which may also contain phrases,
+  // prefixes and fuzzy terms (see Query.hpp).  Documents are first matched
+  // on all of the query's words and then checked for each phrase by
+  // merging the positions of its words.  If some word of a phrase has no
+  // positions the phrase is only matched as the words it is made of.
+  // Every distinct word adds its BM25 score once.
+  //
+  // A prefix is expanded into the (at most kMaxExpansions) words in the
+  // index that start with it, found by walking the sorted dictionary.  A
+  // document matches a prefix if it contains any of those words and
+  // scores the sum of their BM25 scores.  A fuzzy term is expanded the
+  // same way into the words within its edit distance, found by running a
+  // Levenshtein automaton along the dictionary, with each edit halving a
+  // word's score.  A group of alternatives stands for all of the words
+  // its terms stand for.
+  //
+  // Every word is looked up and every group expanded before any postings
+  // are decoded, so a query with a term that matches nothing returns
+  // right away.  The words and groups are then intersected from the
+  // fewest documents to the most.  Each group is either merged into one
+  // list or, once the candidates are few enough, probed for each of them
+  // (see should_probe()).  The documents containing any excluded word are
+  // dropped before the phrases are checked, with an anti-join that seeks
+  // a cursor through the word's postings.
+  vector<Result> lookup_query(const Query& query, size_t k, size_t offset,
+                              size_t* num_results = nullptr);
+
   // delete cctor and op=
   WordIndex(const WordIndex& other) = delete;
   WordIndex& operator=(const WordIndex& other) = delete;
 
  private:
-  // TODO: add
-  // STL container to record which documents contain a word and how many times
-  unordered_map<string, unordered_map<string, size_t>> word_index_;
+  // What a lookup needs to know about one word: its postings in the
+  // frozen layout and those added to its shard since, and its IDF.  All
+  // DocIds in "delta" are at least frozen_docs_, all in "base" below it.
+  struct WordRef {
+    PostingListView base;
+    PostingListView delta;
+    float idf;
+    size_t term;
+
+    // How much the word's scores count for, below 1 for words that only
+    // approximately match the query
+    float boost;
+
+    size_t size() const { return base.size() + delta.size(); }
+  };
+
+  // One step of a QueryPlan: a word, or a group of words any of which a
+  // document may contain, and the number of documents it is in (for a
+  // group, the sum over its words, which bounds it from above)
+  struct PlanStep {
+    size_t doc_freq;
+    bool group;
+    size_t index;
+  };
+
+  // How match_query() evaluates a query: the postings of every word, the
+  // words every prefix, fuzzy term and group of alternatives stands for,
+  // and the order to intersect them in, rarest first
+  struct QueryPlan {
+    vector<WordRef> words;
+    vector<vector<WordRef>> groups;
+    vector<PlanStep> steps;
+  };
+
+  // Roughly how many postings a merge reads in the time a cursor takes to
+  // seek to a DocId, for choosing between the two (see should_probe())
+  static constexpr size_t kProbeCost = 16;
+
+  // Everything the index knows about one word: its posting list, kept
+  // sorted by DocId so that lookup_query can intersect lists with a merge
+  // instead of comparing every pair, and its IDF as of the last compact()
+  struct WordInfo {
+    PostingList postings;
+    float idf = 0;
+  };
+
+  // One shard of the words.  "lock" guards "words"
+  struct Shard {
+    pthread_rwlock_t lock;
+    TermMap<WordInfo> words;
+  };
+
+  // Returns the shard a word belongs to
+  static size_t shard_of(std::string_view word);
+
+  // Looks up a word in the frozen layout and in its shard, whose read lock
+  // the caller must hold for as long as it uses "ref".  Returns false if
+  // the word is not in the index
+  bool find_word(std::string_view word, WordRef* ref);
+
+  // Adds a document to the end of the doc table and returns its DocId.
+  // docs_lock_ must be held for writing
+  DocId append_doc(const string& doc_name, uint32_t length,
+                   const FileStamp& stamp = FileStamp());
+
+  // Adds the postings of a whole document, locking each shard once
+  void add_postings(DocId doc_id, const Document& doc);
+
+  // Adds a word to a shard of an index that is being built by rebuild()
+  // with the postings of "postings" whose documents are still there,
+  // renumbered through "new_ids".  The word is left out if there are none
+  void add_renumbered(std::string_view word,
+                      const vector<PostingListView>& postings,
+                      const vector<DocId>& new_ids);
+
+  // Moves the frozen layout, if any, back into the shards and drops the
+  // postings of removed documents, ready to be compacted and frozen again
+  void thaw();
+
+  // The body of a thread of merge(), merging shards until there are none
+  // left.  "arg" is the MergeTask the threads share
+  static void* merge_thread(void* arg);
+
+  // Appends the postings of shard "s" of every part to shard "s", adding
+  // offsets[p] to the DocIds of parts[p]
+  void merge_shard(size_t s, const vector<std::unique_ptr<WordIndex>>& parts,
+                   const vector<DocId>& offsets);
+
+  // Returns true if the document has been removed.  docs_lock_ must be
+  // held
+  bool is_removed(DocId doc_id) const {
+    return doc_id < removed_.size() && removed_[doc_id] != 0;
+  }
+
+  // Returns every document matching the query along with its summed
+  // score, in DocId order
+  vector<Result> match_query(const Query& query);
+
+  // Keeps only the documents in "doc_ids" in which the words occur next
+  // to each other, in order.  Every document must contain every word
+  void match_phrase(const vector<const WordRef*>& words,
+                    vector<DocId>* doc_ids);
+
+  // Looks up every term of "query", whose words (on their own or in a
+  // phrase) are "terms", and orders them from rarest to most common.
+  // Nothing is decoded yet.  Returns false if some term is in no document,
+  // in which case no document matches the query.  The caller must hold the
+  // read locks of every shard the terms can be in
+  bool plan_query(const Query& query, const vector<std::string_view>& terms,
+                  QueryPlan* plan);
+
+  // Returns true if a group of "num_words" words in "doc_freq" documents
+  // in total is cheaper to check against "num_candidates" candidates by
+  // seeking each word to each of them than by merging the words' postings
+  static bool should_probe(size_t num_candidates, size_t num_words,
+                           size_t doc_freq);
+
+  // Keeps only the documents in "doc_ids" that contain some word of
+  // "group", seeking a cursor through each word's postings
+  void probe_group(const vector<WordRef>& group, vector<DocId>* doc_ids);
+
+  // Adds the scores of the words of "group" each result contains to it.
+  // "results" must be in DocId order
+  void add_group_scores(const vector<WordRef>& group,
+                        vector<Result>* results);
+
+  // Appends the words starting with "prefix" to "matches".  The caller
+  // must hold every shard's read lock
+  void expand_prefix(const string& prefix, vector<WordRef>* matches);
+
+  // Appends the words within the term's edit distance of it to "matches".
+  // The caller must hold every shard's read lock
+  void expand_fuzzy(const FuzzyTerm& fuzzy, vector<WordRef>* matches);
+
+  // Appends every word "terms" stands for to "matches".  The caller must
+  // hold the read locks of every shard those words can be in
+  void expand_terms(const Terms& terms, vector<WordRef>* matches);
+
+  // Keeps only the documents in "doc_ids" that do not contain the word,
+  // seeking through its postings with a cursor instead of decoding them.
+  // "doc_ids" must be in DocId order
+  void exclude(const WordRef& ref, vector<DocId>* doc_ids);
+
+  // Cuts an expansion down to at most kMaxExpansions words
+  static void limit_expansions(vector<WordRef>* matches);
+
+  // Merges the postings of several words with a k-way heap merge,
+  // returning every document that contains any of them, in DocId order,
+  // along with the summed score of the words it contains
+  vector<Result> merge_postings(const vector<WordRef>& words);
+
+  // Keeps only the documents in "doc_ids" that are also in "merged".
+  // Both must be in DocId order
+  static void intersect_results(const vector<Result>& merged,
+                                vector<DocId>* doc_ids);
+
+  // Adds the rank each result has in "merged" to it.  Both must be in
+  // DocId order and every result must be in "merged"
+  static void add_scores(const vector<Result>& merged,
+                         vector<Result>* results);
+
+  // Returns the score of the posting "cursor" is on
+  float score(const PostingListView& postings,
+              PostingListView::Cursor* cursor, float idf, DocId doc_id) {
+    return postings.has_impacts()
+               ? postings.impact(cursor->index()) * impact_scale_
+               : bm25_.score(idf, cursor->count(), doc_id);
+  }
+
+  // Adds the score of one more word to the rank of every result in
+  // [begin, end), using the stored impact scores if there are any.  The
+  // results must be in DocId order and every one of them must be in
+  // "postings"
+  void add_scores(const PostingListView& postings, float idf, Result* begin,
+                  Result* end);
+
+  // Same as above, for every result, whichever part of the word's
+  // postings it is in
+  void add_scores(const WordRef& ref, vector<Result>* results);
+
+  // The doc table: doc_names_[id] is the name of the document with that
+  // DocId, doc_lengths_[id] its length in words, doc_stamps_[id] where it
+  // came from, removed_[id] is non-zero if it has been removed, and
+  // doc_ids_ maps the name of every document still in the index to its
+  // DocId.  All guarded by docs_lock_.
+  //
+  // Locks are always taken in the order: shard locks in increasing shard
+  // order, then docs_lock_.  Updates never hold more than one at a time;
+  // rebuild() holds all of them to swap the new index in.
+  pthread_rwlock_t docs_lock_;
+  vector<string> doc_names_;
+  vector<uint32_t> doc_lengths_;
+  vector<FileStamp> doc_stamps_;
+  vector<uint8_t> removed_;
+  unordered_map<string, DocId> doc_ids_;
+
+  // The number of documents removed since the last freeze()
+  size_t pending_removals_;
+
+  // The words that are not in the frozen layout, or were added to since
+  // it was built
+  Shard shards_[kNumShards];
+
+  // The index file opened by open(), or nullptr.  Must outlive frozen_,
+  // which may point into it
+  std::unique_ptr<IndexFileReader> file_;
+
+  // The read-only layout built by freeze() or loaded by open(), or nullptr,
+  // and the number of documents it covers
+  std::unique_ptr<FrozenIndex> frozen_;
+  DocId frozen_docs_;
+
+  // Scoring state precomputed by compact()
+  BM25 bm25_;
+  bool impact_scores_;
+  float impact_scale_;
+
+  // Whether add_document() records positions
+  bool positions_;
+
+  // Bumped at the end of every update, see generation()
+  std::atomic<uint64_t> generation_;
+
+  // Bumped by every rebuild(), see numbering()
+  std::atomic<uint64_t> numbering_;
 };
 
 }  // namespace searchserver
@@ -0,0 +1,145 @@
+// Microbenchmark comparing the compressed PostingList against the
+// map-of-maps layout WordIndex used to keep its postings in
+// (word -> document name -> count).
+//
+// Builds the same synthetic Zipf-distributed corpus into both layouts,
+// then reports the memory each one takes and how fast every posting of
+// every word can be decoded/visited.
+//
+// Usage: ./bench_postings [num_docs] [words_per_doc]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./PostingList.hpp"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::unordered_map;
+using std::vector;
+using searchserver::DocId;
+using searchserver::Posting;
+using searchserver::PostingList;
+
+typedef unordered_map<string, unordered_map<string, size_t>> MapOfMaps;
+
+static constexpr size_t kVocabulary = 50000;
+static constexpr int kRounds = 5;
+
+// Rough heap footprint of an unordered_map node holding "value_bytes",
+// plus the separately allocated bytes of a long std::string key
+static size_t node_bytes(size_t value_bytes, const string& key) {
+  size_t bytes = value_bytes + 2 * sizeof(void*);
+  if (key.size() >= 16) {
+    bytes += key.size() + 1;
+  }
+  return bytes;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  size_t num_docs = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+  size_t words_per_doc = argc > 2 ? strtoul(argv[2], nullptr, 10) : 300;
+
+  // Build both layouts from the same token stream
+  std::mt19937 rng(5950);
+  std::discrete_distribution<size_t> zipf = [] {
+    vector<double> weights(kVocabulary);
+    for (size_t i = 0; i < kVocabulary; i++) {
+      weights[i] = 1.0 / static_cast<double>(i + 1);
+    }
+    return std::discrete_distribution<size_t>(weights.begin(), weights.end());
+  }();
+
+  MapOfMaps map_of_maps;
+  unordered_map<string, PostingList> lists;
+  for (size_t d = 0; d < num_docs; d++) {
+    string doc_name = "./test_tree/corpus/section" + std::to_string(d % 97) +
+                      "/document_" + std::to_string(d) + ".txt";
+    for (size_t w = 0; w < words_per_doc; w++) {
+      string word = "w" + std::to_string(zipf(rng));
+      map_of_maps[word][doc_name]++;
+      lists[word].add(static_cast<DocId>(d), 1);
+    }
+  }
+  for (auto& entry : lists) {
+    entry.second.seal();
+  }
+
+  // Memory
+  size_t num_postings = 0;
+  size_t map_bytes = map_of_maps.bucket_count() * sizeof(void*);
+  for (const auto& word : map_of_maps) {
+    map_bytes += node_bytes(sizeof(word), word.first);
+    map_bytes += word.second.bucket_count() * sizeof(void*);
+    for (const auto& doc : word.second) {
+      map_bytes += node_bytes(sizeof(doc), doc.first);
+      num_postings++;
+    }
+  }
+  size_t list_bytes = lists.bucket_count() * sizeof(void*);
+  for (const auto& word : lists) {
+    list_bytes += node_bytes(sizeof(word), word.first);
+    list_bytes += word.second.memory_bytes() - sizeof(word.second);
+  }
+
+  cout << "corpus: " << num_docs << " documents, " << lists.size()
+       << " words, " << num_postings << " postings" << endl;
+  cout << "memory:" << endl;
+  cout << "  map of maps:  " << map_bytes / 1024 << " KiB ("
+       << static_cast<double>(map_bytes) / num_postings << " bytes/posting)"
+       << endl;
+  cout << "  posting list: " << list_bytes / 1024 << " KiB ("
+       << static_cast<double>(list_bytes) / num_postings << " bytes/posting)"
+       << endl;
+
+  // Decode throughput: visit every posting of every word
+  uint64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    for (const auto& word : map_of_maps) {
+      for (const auto& doc : word.second) {
+        checksum += doc.second;
+      }
+    }
+  }
+  double map_secs = seconds_since(start);
+
+  DocId doc_ids[PostingList::kBlockSize];
+  uint32_t counts[PostingList::kBlockSize];
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    for (const auto& word : lists) {
+      searchserver::PostingListView list = word.second.view();
+      for (size_t b = 0; b < list.num_blocks(); b++) {
+        size_t n = list.decode_doc_ids(b, doc_ids);
+        list.decode_counts(b, counts);
+        for (size_t i = 0; i < n; i++) {
+          checksum += counts[i] + (doc_ids[i] & 1);
+        }
+      }
+    }
+  }
+  double list_secs = seconds_since(start);
+
+  double total = static_cast<double>(num_postings) * kRounds;
+  cout << "decode throughput:" << endl;
+  cout << "  map of maps:  " << total / map_secs / 1e6 << " M postings/s"
+       << endl;
+  cout << "  posting list: " << total / list_secs / 1e6 << " M postings/s"
+       << endl;
+  cout << "(checksum " << checksum << ")" << endl;
+  return EXIT_SUCCESS;
+}
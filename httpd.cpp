@@ -17,6 +17,7 @@
 #include <signal.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <list>
 #include <string>
@@ -24,6 +25,8 @@
 #include "./ServerSocket.hpp"
 #include "./HttpServer.hpp"
 #include "./CrawlFileTree.hpp"
+#include "./QueryCache.hpp"
+#include "./TreeWatcher.hpp"
 
 using std::cerr;
 using std::cout;
@@ -31,20 +34,47 @@ using std::endl;
 using std::list;
 using std::string;
 
+// Everything that can be configured on the command line.
+struct Options {
+  // The port number to listen on
+  uint16_t port;
+
+  // The directory containing our static files
+  string path;
+
+  // The number of query results to show per page ("--page-size N")
+  size_t page_size;
+
+  // Whether to store quantized scores in the index ("--impact-scores")
+  bool impact_scores;
+
+  // Whether to store word positions for phrase queries (on unless
+  // "--no-positions")
+  bool positions;
+
+  // An index file to serve from ("--index FILE"), or empty to always
+  // crawl "path"
+  string index_file;
+
+  // The number of result pages to cache ("--cache-size N"), 0 for none
+  size_t cache_size;
+
+  // The number of threads to crawl "path" with ("--crawl-threads N"), by
+  // default one per online core
+  uint32_t crawl_threads;
+
+  // Whether to keep the index up to date with changes to "path" while
+  // serving ("--watch")
+  bool watch;
+};
+
 // Print out program usage, and exit() with EXIT_FAILURE.
 static void Usage(char *prog_name);
 
-// Parses the command-line arguments, invokes Usage() on failure.
-// "port" is a return parameter to the port number to listen on,
-// "path" is a return parameter to the directory containing
-// our static files, and "indices" is a return parameter to a
-// list of index filenames.  Ensures that the path is a readable
-// directory, and the index filenames are readable, and if not,
-// invokes Usage() to exit.
-static void GetPortAndPath(int argc,
-                    char **argv,
-                    uint16_t *port,
-                    string *path);
+// Parses the command-line arguments into "options", invokes Usage()
+// on failure.  Ensures that the path is a readable directory, and
+// if not, invokes Usage() to exit.
+static void GetOptions(int argc, char **argv, Options *options);
 
 int main(int argc, char **argv) {
   // Print out welcome message.
@@ -55,26 +85,80 @@ int main(int argc, char **argv) {
   // disconnects unexpectedly.
   signal(SIGPIPE, SIG_IGN);
 
-  // Get the port number and list of index files.
-  uint16_t port_num;
-  string static_dir;
-  GetPortAndPath(argc, argv, &port_num, &static_dir);
-  cout << "    port: " << port_num << endl;
-  cout << "    path: " << static_dir << endl;
+  // Get the port number, static files directory and other options.
+  Options options;
+  GetOptions(argc, argv, &options);
+  cout << "    port: " << options.port << endl;
+  cout << "    path: " << options.path << endl;
+  cout << "    page size: " << options.page_size << endl;
+  cout << "    cache size: " << options.cache_size << endl;
+  cout << "    crawl threads: " << options.crawl_threads << endl;
+  cout << "    watch: " << (options.watch ? "yes" : "no") << endl;
 
   searchserver::WordIndex *index = new searchserver::WordIndex();
- 
-  if (!searchserver::crawl_filetree(static_dir, index)) {
+  index->set_impact_scores(options.impact_scores);
+  index->set_positions(options.positions);
+
+  // Start from the saved index if there is a usable one, and crawl the
+  // tree to bring it up to date: only the files added, changed or removed
+  // since it was saved are indexed again.  Without one, everything is.
+  bool loaded = false;
+  if (!options.index_file.empty()) {
+    string error;
+    loaded = index->open(options.index_file, &error);
+    if (loaded) {
+      cout << "  loaded index " << options.index_file << endl;
+    } else {
+      cout << "  can't use index file: " << error << endl;
+    }
+  }
+
+  size_t num_changed = 0;
+  if (!searchserver::crawl_filetree(options.path, index,
+                                    options.crawl_threads, &num_changed)) {
     cerr << " failed to crawl the file directory" << endl;
     return EXIT_FAILURE;
   }
+  if (loaded) {
+    cout << "  " << num_changed << " files changed since it was saved"
+         << endl;
+  }
+
+  if (!loaded || num_changed != 0) {
+    // Switch the index to the read-only layout, whose locks the worker
+    // threads only contend for with the updates of --watch.
+    index->freeze();
+
+    if (!options.index_file.empty()) {
+      if (index->save(options.index_file)) {
+        cout << "  saved index " << options.index_file << endl;
+      } else {
+        cerr << "  failed to save index " << options.index_file << endl;
+      }
+    }
+  }
+
+  // Keep indexing the files that change while serving.  The changes are
+  // only saved to the index file the next time the tree is crawled.
+  searchserver::TreeWatcher watcher(options.path, index);
+  if (options.watch) {
+    string error;
+    if (watcher.start(&error)) {
+      cout << "  watching " << options.path << " for changes" << endl;
+    } else {
+      cerr << "  can't watch for changes: " << error << endl;
+    }
+  }
 
   // Run the server.
-  searchserver::HttpServer hs(port_num, static_dir, index);
+  searchserver::QueryCache cache(options.cache_size);
+  searchserver::HttpServer hs(options.port, options.path, index,
+                              options.page_size, &cache);
   if (!hs.run()) {
     cerr << "  server failed to run!?" << endl;
   }
 
+  watcher.stop();
   delete index;
 
   cout << "server completed!  Exiting." << endl;
@@ -83,48 +167,107 @@ int main(int argc, char **argv) {
 
 
 static void Usage(char *prog_name) {
-  cerr << "Usage: " << prog_name << " port staticfiles_directory";
+  cerr << "Usage: " << prog_name
+       << " [--page-size N] [--impact-scores] [--no-positions]"
+       << " [--index FILE] [--cache-size N] [--crawl-threads N] [--watch]"
+       << " port staticfiles_directory";
   cerr << endl;
   exit(EXIT_FAILURE);
 }
 
-static void GetPortAndPath(int argc,
-                    char **argv,
-                    uint16_t *port,
-                    string *path) {
+static void GetOptions(int argc, char **argv, Options *options) {
   // Be sure to check a few things:
   //  (a) that you have a sane number of command line arguments
   //  (b) that the port number is reasonable
-  //  (c) that "path" (i.e., argv[2]) is a readable directory
+  //  (c) that "path" is a readable directory
+
+  // STEP 0:
+  // Pull off any "--flag [value]" options in front of the port.
+  options->page_size = searchserver::HttpServer::kDefaultPageSize;
+  options->impact_scores = false;
+  options->positions = true;
+  options->watch = false;
+  options->cache_size = searchserver::QueryCache::kDefaultCapacity;
+  long num_cores = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT(runtime/int)
+  options->crawl_threads = num_cores > 0 ? static_cast<uint32_t>(num_cores)
+                                         : 1;
+  int arg = 1;
+  while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+    const char *flag = argv[arg++];
+    if (strcmp(flag, "--impact-scores") == 0) {
+      options->impact_scores = true;
+      continue;
+    }
+    if (strcmp(flag, "--no-positions") == 0) {
+      options->positions = false;
+      continue;
+    }
+    if (strcmp(flag, "--watch") == 0) {
+      options->watch = true;
+      continue;
+    }
+
+    // Every other flag takes a value.
+    if (arg >= argc) {
+      cerr << endl << flag << " is missing its value." << endl;
+      Usage(argv[0]);
+    }
+    const char *value = argv[arg++];
+    if (strcmp(flag, "--page-size") == 0) {
+      if ((sscanf(value, "%zu", &options->page_size) != 1) ||
+          (options->page_size == 0)) {
+        cerr << endl << value << " isn't a valid page size." << endl;
+        Usage(argv[0]);
+      }
+    } else if (strcmp(flag, "--index") == 0) {
+      options->index_file = value;
+    } else if (strcmp(flag, "--cache-size") == 0) {
+      if (sscanf(value, "%zu", &options->cache_size) != 1) {
+        cerr << endl << value << " isn't a valid cache size." << endl;
+        Usage(argv[0]);
+      }
+    } else if (strcmp(flag, "--crawl-threads") == 0) {
+      if ((sscanf(value, "%u", &options->crawl_threads) != 1) ||
+          (options->crawl_threads == 0)) {
+        cerr << endl << value << " isn't a valid number of threads." << endl;
+        Usage(argv[0]);
+      }
+    } else {
+      cerr << endl << flag << " isn't a known option." << endl;
+      Usage(argv[0]);
+    }
+  }
 
   // STEP 1:
   // Do we have the right number of command line arguments?
-  if (argc != 3) {
+  if (argc - arg != 2) {
     cerr << endl;
     Usage(argv[0]);
   }
+  char *port_arg = argv[arg];
+  char *path_arg = argv[arg + 1];
 
   // Try to get the port number.
-  if (sscanf(argv[1], "%hu", port) != 1) {
-    cerr << endl << argv[1] << " isn't a valid port number." << endl;
+  if (sscanf(port_arg, "%hu", &options->port) != 1) {
+    cerr << endl << port_arg << " isn't a valid port number." << endl;
     Usage(argv[0]);
   }
 
   // Test to see if "path" is a readable directory.
   struct stat fs;
-  if ((stat(argv[2], &fs) == -1) ||
+  if ((stat(path_arg, &fs) == -1) ||
       (!S_ISDIR(fs.st_mode))) {
-    cerr << endl << argv[2] << " isn't a directory." << endl;
+    cerr << endl << path_arg << " isn't a directory." << endl;
     Usage(argv[0]);
   }
 
-  DIR *d = opendir(argv[2]);
+  DIR *d = opendir(path_arg);
   if (d == nullptr) {
-    cerr << endl << argv[2] << " isn't a readable directory." << endl;
+    cerr << endl << path_arg << " isn't a readable directory." << endl;
     Usage(argv[0]);
   }
 
   closedir(d);
-  *path = argv[2];
+  options->path = path_arg;
 }
 